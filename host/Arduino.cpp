@@ -0,0 +1,135 @@
+#include "Arduino.h"
+
+#include <time.h>
+#include <avr/eeprom.h>
+
+HardwareSerial Serial;
+
+volatile uint8_t SREG;
+volatile uint8_t TWBR, TWSR, TWCR, TWDR, TWAR;
+volatile uint8_t TCCR1A, TCCR1B, TIMSK1;
+volatile uint16_t TCNT1, OCR1A;
+
+uint8_t host_eeprom[E2END + 1];
+
+static uint8_t pin_state[NUM_DIGITAL_PINS];
+
+static uint64_t clock_us( void ) {
+  timespec t;
+  clock_gettime( CLOCK_MONOTONIC, &t );
+  return (uint64_t)t.tv_sec * 1000000 + t.tv_nsec / 1000;
+}
+
+static uint64_t started_us = clock_us();
+
+// Both wrap at 32 bits, as on the board
+unsigned long millis( void ) {
+  return (uint32_t)( ( clock_us() - started_us ) / 1000 );
+}
+
+unsigned long micros( void ) {
+  return (uint32_t)( clock_us() - started_us );
+}
+
+// Interrupts do not run on the host: whatever stands in for them,
+// the bus emulation of the native test for one, hooks yield()
+void yield( void ) __attribute__( ( weak ) );
+void yield( void ) {}
+
+// Calls yield() while it waits, as the core does
+void delay( unsigned long ms ) {
+  unsigned long since = millis();
+  while ( millis() - since < ms ) {
+    yield();
+    delayMicroseconds( 100 );
+  }
+}
+
+void delayMicroseconds( unsigned int us ) {
+  timespec t = { 0, (long)us * 1000 };
+  nanosleep( &t, NULL );
+}
+
+// Pins read back what was written, relays included
+void pinMode( uint8_t pin, uint8_t mode ) {
+  if ( pin < NUM_DIGITAL_PINS && mode == INPUT_PULLUP ) {
+    pin_state[pin] = HIGH;
+  }
+}
+
+void digitalWrite( uint8_t pin, uint8_t value ) {
+  if ( pin < NUM_DIGITAL_PINS ) {
+    pin_state[pin] = value ? HIGH : LOW;
+  }
+}
+
+int digitalRead( uint8_t pin ) {
+  return pin < NUM_DIGITAL_PINS ? pin_state[pin] : LOW;
+}
+
+int analogRead( uint8_t pin ) {
+  return 0;
+}
+
+void analogReference( uint8_t mode ) {}
+
+void analogWrite( uint8_t pin, int value ) {
+  digitalWrite( pin, value >= 128 );
+}
+
+void tone( uint8_t pin, unsigned int frequency, unsigned long duration ) {}
+
+void noTone( uint8_t pin ) {}
+
+unsigned long pulseIn( uint8_t pin, uint8_t state, unsigned long timeout ) {
+  return 0;
+}
+
+void attachInterrupt( uint8_t interrupt, void ( *handler )( void ), int mode ) {}
+
+void detachInterrupt( uint8_t interrupt ) {}
+
+long random( long high ) {
+  return high > 0 ? rand() % high : 0;
+}
+
+long random( long low, long high ) {
+  return low < high ? low + random( high - low ) : low;
+}
+
+void randomSeed( unsigned long seed ) {
+  srand( seed );
+}
+
+long map( long x, long in_min, long in_max, long out_min, long out_max ) {
+  return ( x - in_min ) * ( out_max - out_min ) / ( in_max - in_min ) + out_min;
+}
+
+size_t HardwareSerial::write( uint8_t b ) {
+  return fputc( b, stderr ) == EOF ? 0 : 1;
+}
+
+size_t Stream::readBytes( char* buffer, size_t length ) {
+  size_t n = 0;
+  unsigned long since = millis();
+  while ( n < length && millis() - since < timeout ) {
+    int c = read();
+    if ( c >= 0 ) {
+      buffer[n++] = c;
+    }
+  }
+  return n;
+}
+
+// The core's main(), without init(): loop() runs flat out, as it does
+// on the board without idle sleep. The native test has its own.
+#ifndef PIO_UNIT_TESTING
+int main( void ) {
+  memset( host_eeprom, 0xFF, sizeof( host_eeprom ) );
+  setup();
+  for ( ;; ) {
+    loop();
+  }
+  return 0;
+}
+#endif
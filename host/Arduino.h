@@ -0,0 +1,112 @@
+#pragma once
+
+// Host stand-in for the parts of the Arduino AVR core the firmware and
+// its libraries use, for the native PlatformIO environment. Time comes
+// from the host clock, pins only remember what was written, and the
+// network is EthernetUdp.h over loopback sockets. Hardware with no
+// stand-in (timers, sleep, SRAM probes, serial telemetry) is left out
+// of the build, see platformio.ini.
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+
+#include "WString.h"
+#include "Print.h"
+#include "Stream.h"
+#include "HardwareSerial.h"
+
+typedef uint8_t byte;
+typedef bool boolean;
+typedef uint16_t word;
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define CHANGE 1
+#define FALLING 2
+#define RISING 3
+
+#define PI 3.1415926535897932384626433832795
+#define HALF_PI 1.5707963267948966192313216916398
+#define TWO_PI 6.283185307179586476925286766559
+#define DEG_TO_RAD 0.017453292519943295769236907684886
+#define RAD_TO_DEG 57.295779513082320876798154814105
+
+// Uno pin numbers
+#define NUM_DIGITAL_PINS 20
+#define LED_BUILTIN 13
+#define A0 14
+#define A1 15
+#define A2 16
+#define A3 17
+#define A4 18
+#define A5 19
+#define SDA 18
+#define SCL 19
+#define NOT_AN_INTERRUPT -1
+#define digitalPinToInterrupt( p ) ( ( p ) == 2 ? 0 : ( ( p ) == 3 ? 1 : NOT_AN_INTERRUPT ) )
+
+#define lowByte( w ) ( (uint8_t)( ( w ) & 0xff ) )
+#define highByte( w ) ( (uint8_t)( ( w ) >> 8 ) )
+#define bit( b ) ( 1UL << ( b ) )
+#define bitRead( value, b ) ( ( ( value ) >> ( b ) ) & 0x01 )
+#define bitSet( value, b ) ( ( value ) |= ( 1UL << ( b ) ) )
+#define bitClear( value, b ) ( ( value ) &= ~( 1UL << ( b ) ) )
+#define bitWrite( value, b, v ) ( ( v ) ? bitSet( value, b ) : bitClear( value, b ) )
+
+// Functions rather than the core's macros, which would break the C++
+// headers of the host
+template <class T, class U>
+inline auto min( T a, U b ) -> decltype( a < b ? a : b ) {
+  return b < a ? b : a;
+}
+template <class T, class U>
+inline auto max( T a, U b ) -> decltype( a < b ? a : b ) {
+  return a < b ? b : a;
+}
+template <class T, class L, class H>
+inline T constrain( T x, L low, H high ) {
+  return x < low ? low : x > high ? high : x;
+}
+template <class T>
+inline T sq( T x ) {
+  return x * x;
+}
+
+unsigned long millis( void );
+unsigned long micros( void );
+void delay( unsigned long ms );
+void delayMicroseconds( unsigned int us );
+void yield( void );  // called by delay(), weak as in the core
+
+void pinMode( uint8_t pin, uint8_t mode );
+void digitalWrite( uint8_t pin, uint8_t value );
+int digitalRead( uint8_t pin );
+int analogRead( uint8_t pin );
+void analogReference( uint8_t mode );
+void analogWrite( uint8_t pin, int value );
+void tone( uint8_t pin, unsigned int frequency, unsigned long duration = 0 );
+void noTone( uint8_t pin );
+unsigned long pulseIn( uint8_t pin, uint8_t state, unsigned long timeout = 1000000L );
+void attachInterrupt( uint8_t interrupt, void ( *handler )( void ), int mode );
+void detachInterrupt( uint8_t interrupt );
+inline void interrupts( void ) {}
+inline void noInterrupts( void ) {}
+
+long random( long high );
+long random( long low, long high );
+void randomSeed( unsigned long seed );
+long map( long x, long in_min, long in_max, long out_min, long out_max );
+
+void setup( void );
+void loop( void );
@@ -0,0 +1,21 @@
+#pragma once
+
+#include "Arduino.h"
+#include "EthernetUdp.h"
+#include "IPAddress.h"
+
+// No W5100 on the host: the board is 127.0.0.1, see EthernetUdp.h
+class EthernetClass {
+ public:
+  int begin( uint8_t* mac, unsigned long timeout = 60000, unsigned long response_timeout = 4000 ) { return 1; }
+  void begin( uint8_t* mac, IPAddress ip ) {}
+  void begin( uint8_t* mac, IPAddress ip, IPAddress dns ) {}
+  void begin( uint8_t* mac, IPAddress ip, IPAddress dns, IPAddress gateway ) {}
+  void begin( uint8_t* mac, IPAddress ip, IPAddress dns, IPAddress gateway, IPAddress subnet ) {}
+  int maintain( void ) { return 0; }
+  IPAddress localIP( void ) { return IPAddress( 127, 0, 0, 1 ); }
+  IPAddress subnetMask( void ) { return IPAddress( 255, 0, 0, 0 ); }
+  IPAddress gatewayIP( void ) { return IPAddress( 127, 0, 0, 1 ); }
+};
+
+extern EthernetClass Ethernet;
@@ -0,0 +1,126 @@
+#include "EthernetUdp.h"
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "Ethernet.h"
+
+EthernetClass Ethernet;
+
+static sockaddr_in socket_address( IPAddress ip, uint16_t port ) {
+  sockaddr_in a;
+  memset( &a, 0, sizeof( a ) );
+  a.sin_family = AF_INET;
+  a.sin_addr.s_addr = (uint32_t)ip;  // both in network order
+  a.sin_port = htons( port );
+  return a;
+}
+
+// A socket for sending only, for a beginPacket() without begin()
+bool EthernetUDP::open( void ) {
+  if ( fd >= 0 ) {
+    return true;
+  }
+  fd = socket( AF_INET, SOCK_DGRAM, 0 );
+  if ( fd < 0 ) {
+    return false;
+  }
+  fcntl( fd, F_SETFL, O_NONBLOCK );
+  return true;
+}
+
+// Listens on 127.0.0.1:port, 0 if the port is taken
+uint8_t EthernetUDP::begin( uint16_t port ) {
+  stop();
+  if ( !open() ) {
+    return 0;
+  }
+  sockaddr_in a = socket_address( IPAddress( 127, 0, 0, 1 ), port );
+  if ( bind( fd, (sockaddr*)&a, sizeof( a ) ) < 0 ) {
+    perror( "EthernetUDP::begin" );
+    stop();
+    return 0;
+  }
+  return 1;
+}
+
+void EthernetUDP::stop( void ) {
+  if ( fd >= 0 ) {
+    close( fd );
+  }
+  fd = -1;
+  rx_len = rx_pos = 0;
+}
+
+int EthernetUDP::beginPacket( IPAddress ip, uint16_t port ) {
+  tx_ip = ip;
+  tx_port = port;
+  tx_len = 0;
+  return open() ? 1 : 0;
+}
+
+int EthernetUDP::beginPacket( const char* host, uint16_t port ) {
+  addrinfo hints, *found;
+  memset( &hints, 0, sizeof( hints ) );
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_DGRAM;
+  if ( getaddrinfo( host, NULL, &hints, &found ) != 0 ) {
+    return 0;
+  }
+  IPAddress ip( (uint32_t)( (sockaddr_in*)found->ai_addr )->sin_addr.s_addr );
+  freeaddrinfo( found );
+  return beginPacket( ip, port );
+}
+
+size_t EthernetUDP::write( uint8_t b ) {
+  return write( &b, 1 );
+}
+
+size_t EthernetUDP::write( const uint8_t* buffer, size_t size ) {
+  if ( size > (size_t)( ETHERNET_UDP_MAX - tx_len ) ) {
+    size = ETHERNET_UDP_MAX - tx_len;
+  }
+  memcpy( tx + tx_len, buffer, size );
+  tx_len += size;
+  return size;
+}
+
+int EthernetUDP::endPacket( void ) {
+  sockaddr_in a = socket_address( tx_ip, tx_port );
+  int sent = sendto( fd, tx, tx_len, 0, (sockaddr*)&a, sizeof( a ) );
+  tx_len = 0;
+  return sent >= 0 ? 1 : 0;
+}
+
+// Size of the next datagram, 0 if none is waiting. The rest of the
+// previous one is dropped.
+int EthernetUDP::parsePacket( void ) {
+  rx_len = rx_pos = 0;
+  if ( fd < 0 ) {
+    return 0;
+  }
+  sockaddr_in a;
+  socklen_t a_len = sizeof( a );
+  ssize_t n = recvfrom( fd, rx, sizeof( rx ), MSG_TRUNC, (sockaddr*)&a, &a_len );
+  if ( n <= 0 ) {
+    return 0;
+  }
+  rx_len = n < ETHERNET_UDP_MAX ? n : ETHERNET_UDP_MAX;
+  remote_ip = IPAddress( (uint32_t)a.sin_addr.s_addr );
+  remote_port = ntohs( a.sin_port );
+  return rx_len;
+}
+
+int EthernetUDP::read( unsigned char* buffer, size_t len ) {
+  int n = available();
+  if ( n > (int)len ) {
+    n = len;
+  }
+  memcpy( buffer, rx + rx_pos, n );
+  rx_pos += n;
+  return n > 0 ? n : -1;
+}
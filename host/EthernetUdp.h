@@ -0,0 +1,45 @@
+#pragma once
+
+#include "Udp.h"
+
+// Loopback stand-in for the W5100 socket: a non-blocking UDP socket
+// bound to 127.0.0.1. parsePacket() takes one datagram, like the chip,
+// and a packet is written into a buffer until endPacket() sends it.
+// Datagrams are cut to the W5100's 2 KB socket buffer.
+#define ETHERNET_UDP_MAX 2048
+
+class EthernetUDP : public UDP {
+ public:
+  EthernetUDP( void ) : fd( -1 ) {}
+  uint8_t begin( uint16_t port );
+  void stop( void );
+
+  int beginPacket( IPAddress ip, uint16_t port );
+  int beginPacket( const char* host, uint16_t port );
+  int endPacket( void );
+  size_t write( uint8_t b );
+  size_t write( const uint8_t* buffer, size_t size );
+  using Print::write;
+
+  int parsePacket( void );
+  int available( void ) { return rx_len - rx_pos; }
+  int read( void ) { return rx_pos < rx_len ? rx[rx_pos++] : -1; }
+  int read( unsigned char* buffer, size_t len );
+  int read( char* buffer, size_t len ) { return read( (unsigned char*)buffer, len ); }
+  int peek( void ) { return rx_pos < rx_len ? rx[rx_pos] : -1; }
+  void flush( void ) { rx_pos = rx_len; }
+  IPAddress remoteIP( void ) { return remote_ip; }
+  uint16_t remotePort( void ) { return remote_port; }
+
+ private:
+  int fd;
+  uint8_t rx[ETHERNET_UDP_MAX];
+  int rx_len, rx_pos;
+  IPAddress remote_ip;
+  uint16_t remote_port;
+  uint8_t tx[ETHERNET_UDP_MAX];
+  int tx_len;
+  IPAddress tx_ip;
+  uint16_t tx_port;
+  bool open( void );
+};
@@ -0,0 +1,23 @@
+#include "Arduino.h"
+#include "IPAddress.h"
+
+bool IPAddress::fromString( const char* s ) {
+  unsigned a[4];
+  char end;
+  if ( sscanf( s, "%u.%u.%u.%u%c", &a[0], &a[1], &a[2], &a[3], &end ) != 4 ) {
+    return false;
+  }
+  for ( uint8_t i = 0; i < 4; i++ ) {
+    if ( a[i] > 255 ) {
+      return false;
+    }
+    bytes[i] = a[i];
+  }
+  return true;
+}
+
+size_t IPAddress::printTo( Print& p ) const {
+  char b[16];
+  snprintf( b, sizeof( b ), "%u.%u.%u.%u", bytes[0], bytes[1], bytes[2], bytes[3] );
+  return p.write( b );
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include "Printable.h"
+#include "WString.h"
+
+// IPv4 address, bytes in network order as the core keeps them
+class IPAddress : public Printable {
+ public:
+  IPAddress( void ) : address( 0 ) {}
+  IPAddress( uint8_t a, uint8_t b, uint8_t c, uint8_t d ) {
+    bytes[0] = a;
+    bytes[1] = b;
+    bytes[2] = c;
+    bytes[3] = d;
+  }
+  IPAddress( uint32_t address ) : address( address ) {}
+  IPAddress( const uint8_t* a ) { memcpy( bytes, a, 4 ); }
+
+  bool fromString( const char* s );
+  bool fromString( const String& s ) { return fromString( s.c_str() ); }
+  operator uint32_t( void ) const { return address; }
+  bool operator==( const IPAddress& o ) const { return address == o.address; }
+  bool operator!=( const IPAddress& o ) const { return address != o.address; }
+  bool operator==( const uint8_t* a ) const { return memcmp( bytes, a, 4 ) == 0; }
+  uint8_t operator[]( int i ) const { return bytes[i]; }
+  uint8_t& operator[]( int i ) { return bytes[i]; }
+  IPAddress& operator=( uint32_t a ) {
+    address = a;
+    return *this;
+  }
+  size_t printTo( Print& p ) const;
+
+ private:
+  union {
+    uint8_t bytes[4];
+    uint32_t address;
+  };
+};
@@ -0,0 +1,28 @@
+#include "Arduino.h"
+
+size_t Print::write( const uint8_t* buffer, size_t size ) {
+  size_t n = 0;
+  while ( size-- ) {
+    n += write( *buffer++ );
+  }
+  return n;
+}
+
+size_t Print::print( long v, int base ) {
+  if ( base == DEC ) {
+    char b[24];
+    snprintf( b, sizeof( b ), "%ld", v );
+    return write( b );
+  }
+  return print( (unsigned long)v, base );
+}
+
+size_t Print::print( unsigned long v, int base ) {
+  return write( String( v, base < 2 ? DEC : base ).c_str() );
+}
+
+size_t Print::print( double v, int digits ) {
+  char b[40];
+  snprintf( b, sizeof( b ), "%.*f", digits, v );
+  return write( b );
+}
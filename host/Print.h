@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "Printable.h"
+#include "WString.h"
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+// Output side of the core's streams
+class Print {
+ public:
+  virtual ~Print() {}
+  virtual size_t write( uint8_t b ) = 0;
+  virtual size_t write( const uint8_t* buffer, size_t size );
+  size_t write( const char* s ) { return s ? write( (const uint8_t*)s, strlen( s ) ) : 0; }
+  size_t write( const char* buffer, size_t size ) { return write( (const uint8_t*)buffer, size ); }
+  virtual int availableForWrite( void ) { return 0; }
+  virtual void flush( void ) {}
+
+  size_t print( const __FlashStringHelper* s ) { return write( reinterpret_cast<const char*>( s ) ); }
+  size_t print( const String& s ) { return write( s.c_str() ); }
+  size_t print( const char* s ) { return write( s ); }
+  size_t print( char c ) { return write( (uint8_t)c ); }
+  size_t print( unsigned char v, int base = DEC ) { return print( (unsigned long)v, base ); }
+  size_t print( int v, int base = DEC ) { return print( (long)v, base ); }
+  size_t print( unsigned int v, int base = DEC ) { return print( (unsigned long)v, base ); }
+  size_t print( long v, int base = DEC );
+  size_t print( unsigned long v, int base = DEC );
+  size_t print( double v, int digits = 2 );
+  size_t print( const Printable& p ) { return p.printTo( *this ); }
+
+  size_t println( void ) { return write( "\r\n" ); }
+  template <class T>
+  size_t println( const T& v ) {
+    size_t n = print( v );
+    return n + println();
+  }
+  template <class T>
+  size_t println( T v, int base ) {
+    size_t n = print( v, base );
+    return n + println();
+  }
+};
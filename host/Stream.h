@@ -0,0 +1,17 @@
+#pragma once
+
+#include "Print.h"
+
+// Input side of the core's streams, without the parsing helpers
+class Stream : public Print {
+ public:
+  virtual int available( void ) = 0;
+  virtual int read( void ) = 0;
+  virtual int peek( void ) = 0;
+  void setTimeout( unsigned long ms ) { timeout = ms; }
+  size_t readBytes( char* buffer, size_t length );
+  size_t readBytes( uint8_t* buffer, size_t length ) { return readBytes( (char*)buffer, length ); }
+
+ protected:
+  unsigned long timeout = 1000;
+};
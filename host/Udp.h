@@ -0,0 +1,30 @@
+#pragma once
+
+#include "IPAddress.h"
+#include "Stream.h"
+
+// The core's datagram interface, which EthernetUDP and CoapIngress
+// implement
+class UDP : public Stream {
+ public:
+  virtual uint8_t begin( uint16_t port ) = 0;
+  virtual uint8_t beginMulticast( IPAddress ip, uint16_t port ) { return 0; }
+  virtual void stop( void ) = 0;
+
+  virtual int beginPacket( IPAddress ip, uint16_t port ) = 0;
+  virtual int beginPacket( const char* host, uint16_t port ) = 0;
+  virtual int endPacket( void ) = 0;
+  virtual size_t write( uint8_t b ) = 0;
+  virtual size_t write( const uint8_t* buffer, size_t size ) = 0;
+  using Print::write;
+
+  virtual int parsePacket( void ) = 0;
+  virtual int available( void ) = 0;
+  virtual int read( void ) = 0;
+  virtual int read( unsigned char* buffer, size_t len ) = 0;
+  virtual int read( char* buffer, size_t len ) = 0;
+  virtual int peek( void ) = 0;
+  virtual void flush( void ) = 0;
+  virtual IPAddress remoteIP( void ) = 0;
+  virtual uint16_t remotePort( void ) = 0;
+};
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <stdlib.h>
+#include <string>
+
+class __FlashStringHelper;
+#define F( s ) ( reinterpret_cast<const __FlashStringHelper*>( s ) )
+
+// Arduino String over std::string, the subset the firmware and its
+// libraries use
+class String {
+ public:
+  String( const char* s = "" ) : s( s ? s : "" ) {}
+  String( const __FlashStringHelper* s ) : s( reinterpret_cast<const char*>( s ) ) {}
+  String( const std::string& s ) : s( s ) {}
+  explicit String( char c ) : s( 1, c ) {}
+  explicit String( int v, unsigned char base = 10 ) : s( number( v, base ) ) {}
+  explicit String( unsigned int v, unsigned char base = 10 ) : s( number( v, base ) ) {}
+  explicit String( long v, unsigned char base = 10 ) : s( number( v, base ) ) {}
+  explicit String( unsigned long v, unsigned char base = 10 ) : s( number( v, base ) ) {}
+  explicit String( double v, unsigned char decimals = 2 ) {
+    char b[40];
+    snprintf( b, sizeof( b ), "%.*f", decimals, v );
+    s = b;
+  }
+
+  unsigned int length( void ) const { return s.size(); }
+  const char* c_str( void ) const { return s.c_str(); }
+  bool reserve( unsigned int size ) {
+    s.reserve( size );
+    return true;
+  }
+  char charAt( unsigned int i ) const { return i < s.size() ? s[i] : 0; }
+  char operator[]( unsigned int i ) const { return charAt( i ); }
+  char& operator[]( unsigned int i ) { return s[i]; }
+
+  bool concat( const String& o ) {
+    s += o.s;
+    return true;
+  }
+  bool concat( const char* o ) {
+    s += o ? o : "";
+    return true;
+  }
+  bool concat( char c ) {
+    s += c;
+    return true;
+  }
+  String& operator+=( const String& o ) {
+    s += o.s;
+    return *this;
+  }
+  String& operator+=( const char* o ) {
+    concat( o );
+    return *this;
+  }
+  String& operator+=( char c ) {
+    s += c;
+    return *this;
+  }
+  friend String operator+( String a, const String& b ) { return a += b; }
+  friend String operator+( String a, const char* b ) { return a += b; }
+
+  bool equals( const String& o ) const { return s == o.s; }
+  bool equals( const char* o ) const { return s == ( o ? o : "" ); }
+  bool operator==( const String& o ) const { return equals( o ); }
+  bool operator==( const char* o ) const { return equals( o ); }
+  bool operator!=( const String& o ) const { return !equals( o ); }
+  bool operator!=( const char* o ) const { return !equals( o ); }
+  bool operator<( const String& o ) const { return s < o.s; }
+  bool startsWith( const String& o ) const { return s.compare( 0, o.s.size(), o.s ) == 0; }
+  bool endsWith( const String& o ) const {
+    return s.size() >= o.s.size() && s.compare( s.size() - o.s.size(), o.s.size(), o.s ) == 0;
+  }
+
+  int indexOf( char c, unsigned int from = 0 ) const {
+    size_t i = s.find( c, from );
+    return i == std::string::npos ? -1 : (int)i;
+  }
+  int indexOf( const String& o, unsigned int from = 0 ) const {
+    size_t i = s.find( o.s, from );
+    return i == std::string::npos ? -1 : (int)i;
+  }
+  String substring( unsigned int from ) const { return from < s.size() ? String( s.substr( from ) ) : String(); }
+  String substring( unsigned int from, unsigned int to ) const {
+    return from < to && from < s.size() ? String( s.substr( from, to - from ) ) : String();
+  }
+  void trim( void ) {
+    size_t b = s.find_first_not_of( " \t\r\n" );
+    size_t e = s.find_last_not_of( " \t\r\n" );
+    s = b == std::string::npos ? "" : s.substr( b, e - b + 1 );
+  }
+  void toLowerCase( void ) {
+    for ( char& c : s ) c = tolower( c );
+  }
+  void toUpperCase( void ) {
+    for ( char& c : s ) c = toupper( c );
+  }
+
+  long toInt( void ) const { return atol( s.c_str() ); }
+  float toFloat( void ) const { return atof( s.c_str() ); }
+
+ private:
+  std::string s;
+
+  template <class T>
+  static std::string number( T v, unsigned char base ) {
+    char b[72];
+    char* p = b + sizeof( b ) - 1;
+    bool negative = v < 0;
+    unsigned long long u = negative ? -(long long)v : (unsigned long long)v;
+    *p = 0;
+    do {
+      unsigned d = u % base;
+      *--p = d < 10 ? '0' + d : 'A' + d - 10;
+      u /= base;
+    } while ( u );
+    if ( negative ) *--p = '-';
+    return p;
+  }
+};
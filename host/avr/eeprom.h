@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <avr/io.h>
+
+// EEPROM kept in memory, erased (0xFF) at every start like a new board
+extern uint8_t host_eeprom[E2END + 1];
+
+inline bool eeprom_is_ready( void ) {
+  return true;
+}
+inline uint8_t eeprom_read_byte( const uint8_t* addr ) {
+  return host_eeprom[(uintptr_t)addr];
+}
+inline void eeprom_write_byte( uint8_t* addr, uint8_t v ) {
+  host_eeprom[(uintptr_t)addr] = v;
+}
+inline void eeprom_update_byte( uint8_t* addr, uint8_t v ) {
+  host_eeprom[(uintptr_t)addr] = v;
+}
+inline void eeprom_read_block( void* dst, const void* src, size_t n ) {
+  memcpy( dst, host_eeprom + (uintptr_t)src, n );
+}
+inline void eeprom_write_block( const void* src, void* dst, size_t n ) {
+  memcpy( host_eeprom + (uintptr_t)dst, src, n );
+}
+inline void eeprom_update_block( const void* src, void* dst, size_t n ) {
+  memcpy( host_eeprom + (uintptr_t)dst, src, n );
+}
@@ -0,0 +1,10 @@
+#pragma once
+
+// Interrupt vectors become plain functions nothing calls
+#define ISR( vector, ... ) extern "C" void vector( void ); void vector( void )
+#define ISR_ALIASOF( v )
+#define ISR_BLOCK
+#define ISR_NOBLOCK
+
+inline void sei( void ) {}
+inline void cli( void ) {}
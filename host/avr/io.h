@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stdint.h>
+
+// ATmega328P, as far as the host build needs it. The TWI registers are
+// plain variables: TwiQueue writes them and, in the program, no
+// interrupt ever answers, so its timeout fails the transaction as with
+// a bus without devices. test/test_native calls TWI_vect() itself with
+// the status an ADS1115 would give.
+
+#ifndef F_CPU
+#define F_CPU 16000000UL
+#endif
+
+#define _BV( b ) ( 1 << ( b ) )
+
+#define RAMSTART 0x100
+#define RAMEND 0x8FF
+#define E2END 0x3FF
+
+extern volatile uint8_t SREG;
+extern volatile uint8_t TWBR, TWSR, TWCR, TWDR, TWAR;
+
+// TWCR
+#define TWIE 0
+#define TWEN 2
+#define TWWC 3
+#define TWSTO 4
+#define TWSTA 5
+#define TWEA 6
+#define TWINT 7
+
+// TWSR
+#define TWPS0 0
+#define TWPS1 1
+
+// Timer1, for SampleClock. Nothing counts: TIMER1_COMPA_vect is never
+// called and main.cpp paces the host build from millis() instead.
+extern volatile uint8_t TCCR1A, TCCR1B, TIMSK1;
+extern volatile uint16_t TCNT1, OCR1A;
+
+// TCCR1B
+#define CS10 0
+#define CS11 1
+#define CS12 2
+#define WGM12 3
+
+// TIMSK1
+#define OCIE1A 1
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// One address space on the host: program memory is ordinary memory
+#define PROGMEM
+#define PGM_P const char*
+#define PSTR( s ) ( s )
+
+#define pgm_read_byte( a ) ( *(const uint8_t*)( a ) )
+#define pgm_read_byte_near( a ) pgm_read_byte( a )
+#define pgm_read_word( a ) ( *(const uint16_t*)( a ) )
+#define pgm_read_word_near( a ) pgm_read_word( a )
+#define pgm_read_dword( a ) ( *(const uint32_t*)( a ) )
+#define pgm_read_float( a ) ( *(const float*)( a ) )
+#define pgm_read_ptr( a ) ( *(void* const*)( a ) )
+
+#define memcpy_P memcpy
+#define memcmp_P memcmp
+#define strcpy_P strcpy
+#define strncpy_P strncpy
+#define strcat_P strcat
+#define strcmp_P strcmp
+#define strncmp_P strncmp
+#define strcasecmp_P strcasecmp
+#define strlen_P strlen
+#define strstr_P strstr
+#define sprintf_P sprintf
+#define snprintf_P snprintf
+#define vsnprintf_P vsnprintf
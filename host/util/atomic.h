@@ -0,0 +1,7 @@
+#pragma once
+
+// Single threaded on the host, a block runs once
+#define ATOMIC_RESTORESTATE
+#define ATOMIC_FORCEON
+#define ATOMIC_BLOCK( type ) for ( int atomic_once = 1; atomic_once; atomic_once = 0 )
+#define NONATOMIC_BLOCK( type ) ATOMIC_BLOCK( type )
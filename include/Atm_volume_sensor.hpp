@@ -1,40 +1,72 @@
 #pragma once
 
 #include <Automaton.h>
-#include <Wire.h>
-#include "ADS1115.h"
+#include "ADS1115Static.h"
+#include "SampleClock.hpp"
+#include "VolumeConversion.hpp"
 
+// Reads the ADS1115 and hands the codes to a VolumeConversion, which
+// does the rest. The machine paces the reads, shares the ADC with the
+// other sensors and pushes the published volume.
 class Atm_volume_sensor : public Machine {
 public:
   enum { IDLE, SAMPLE, SEND };            // STATES
   enum { EVT_TRIGGER, EVT_TIMER, ELSE };  // EVENTS
 
   Atm_volume_sensor( void ) : Machine(){};
-  Atm_volume_sensor& begin(int samplerate = 50 );
-  Atm_volume_sensor& average( uint16_t* v, uint16_t size );
+  Atm_volume_sensor& begin(int samplerate = 50, uint8_t channel = 0 );
+  Atm_volume_sensor& oversample( uint8_t shift );
+  Atm_volume_sensor& clock( SampleClock& clock );
+  Atm_volume_sensor& window( SampleWindow& w );
+  Atm_volume_sensor& estimate( VolumeEstimator& e, Machine& in, Machine& out );
+  Atm_volume_sensor& deadtime( DeadTime& d );
+  Atm_volume_sensor& warm( const estimator_state_t& s );
+  Atm_volume_sensor& calibrate( const volume_calibration_t& c );
+  bool trim( int16_t codes, uint8_t source ) { return conversion.trim( codes, source ); }
+  bool zero( uint8_t source ) { return conversion.zero( source ); }
+  bool reference( void );
+  int16_t zero_trim( void ) { return conversion.zero_trim(); }
+  uint8_t zero_source( void ) { return conversion.zero_source(); }
+  bool referencing( void ) { return conversion.referencing(); }
+  int flow( void ) { return conversion.flow(); }
   int state( void );
-  Atm_volume_sensor& range( int toLow, int toHigh );
+  int16_t code( void ) { return conversion.code(); }
+  uint16_t full_scale( void ) { return conversion.full_scale(); }
+  uint8_t pga( void ) { return conversion.range(); }
+  uint16_t sample_period( void );
+  Atm_volume_sensor& threshold( int v );
   Atm_volume_sensor& onChange( Machine& machine, int event = 0 );
   Atm_volume_sensor& onChange( atm_cb_push_t callback, int idx = 0 );
-  Atm_volume_sensor& set( int value );
 
  private:
   enum { ENT_SAMPLE, ENT_SEND };  // ACTIONS
-  short pin;
   atm_timer_millis timer;
-  int v_sample, v_threshold, v_previous;
+  SampleClock* sample_clock;
+  Machine *pump_in, *pump_out;
+  bool read_pending;  // conversion read queued on the bus
+  bool config_pending;  // config write refused by a full TWI pool
   atm_connector onchange;
-  uint16_t* avg_buf;
-  uint16_t avg_buf_size;
-  uint16_t avg_buf_head;
-  uint32_t avg_buf_total;
-  int toLow, toHigh;
+  VolumeConversion conversion;
+  int samplerate;
 
-  ADS1115 ads;
+  // Sensors sharing the ADC, see begin(). The owner has the input
+  // multiplexer and takes the ticks.
+  uint8_t channel;
+  Atm_volume_sensor* scan_next;
+  static Atm_volume_sensor* scan_owner;
+  static uint8_t scan_size;
 
-  int avg();
-  int sample();
-  virtual int read_sample();
+  // Pressure transmitters on AIN0-3, continuous conversions at 860SPS.
+  // The PGA gain comes from the calibration, or from auto-ranging.
+  typedef ADS1115Static<ADS1115_DEFAULT_ADDRESS, GAIN_TWO, RATE_860, MODE_CONTIN> adc;
+
+  void request();
+  void select( void );
+  void write_config( void );
+  void pass( void );
+  void retime( void );
+  void take( bool ok, int16_t code );
+  static void on_read( const twi_transaction_t& t, void* context );
   int event( int id );
   void action( int id );
 
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <Arduino.h>
+#include <Udp.h>
+
+#ifndef COAP_DEDUP_SIZE
+#define COAP_DEDUP_SIZE 4
+#endif
+
+// EXCHANGE_LIFETIME from RFC 7252, in ms
+#define COAP_EXCHANGE_LIFETIME 247000UL
+
+// Remembers the response code sent for the last few (endpoint, message ID)
+// pairs, so a retransmitted request gets the same answer without running
+// its handler again. Only payload-less responses are cached.
+class CoapDedup {
+ public:
+  CoapDedup& begin( uint32_t lifetime = COAP_EXCHANGE_LIFETIME );
+  bool lookup( IPAddress ip, uint16_t port, uint16_t messageid, uint8_t& code );
+  void store( IPAddress ip, uint16_t port, uint16_t messageid, uint8_t code );
+
+ private:
+  struct entry_t {
+    uint32_t ip;
+    uint16_t port;
+    uint16_t messageid;
+    uint32_t stored;
+    uint8_t code;  // 0: free slot
+  };
+  entry_t entries[COAP_DEDUP_SIZE];
+  uint32_t lifetime;
+
+  bool expired( const entry_t& e, uint32_t now ) { return e.code == 0 || now - e.stored >= lifetime; }
+};
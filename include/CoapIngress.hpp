@@ -0,0 +1,105 @@
+#pragma once
+
+#include <Arduino.h>
+#include <Udp.h>
+#include <coap.h>
+
+#ifndef COAP_INGRESS_SLOTS
+#define COAP_INGRESS_SLOTS 2
+#endif
+
+// Largest request kept, bigger datagrams are dropped
+#ifndef COAP_INGRESS_MTU
+#define COAP_INGRESS_MTU 64
+#endif
+
+// Resources served by CoapIngress itself, past the 10 Coap can hold
+#ifndef COAP_INGRESS_HANDLERS
+#define COAP_INGRESS_HANDLERS 4
+#endif
+
+// Max-Age sent with 5.03 when the queue is full of confirmable requests
+#define COAP_INGRESS_RETRY_AFTER 2
+
+struct coap_ingress_stats_t {
+  uint16_t queued;    // datagrams accepted into the queue
+  uint16_t dropped;   // non-confirmable or oversized datagrams discarded
+  uint16_t rejected;  // confirmable requests answered 5.03
+  uint16_t served;    // datagrams handed to Coap or a handler
+  uint8_t peak;       // deepest queue seen
+};
+
+// UDP stand-in between the network and Coap. poll() drains every datagram
+// the network chip holds into a fixed queue, and Coap::loop() then sees
+// at most serve(n) of them per call through parsePacket() / read().
+// When the queue is full the oldest non-confirmable request is dropped,
+// or a new confirmable request is answered 5.03 with Max-Age.
+//
+// Coap only dispatches exact paths. With collection("tank") set, a
+// request for tank/<n>/<resource> reaches Coap as <resource> and the
+// handler finds n in index(), 0 for paths outside the collection.
+//
+// Coap also only holds 10 resources. Those registered with server()
+// here are dispatched before Coap sees the request, with the same
+// handler signature.
+class CoapIngress : public UDP {
+ public:
+  CoapIngress( UDP& udp ) : udp( udp ){};
+
+  void poll( void );
+  void serve( uint8_t n ) { allowance = n; }
+  uint8_t pending( void ) { return depth; }
+  void collection( const char* name ) { collection_name = name; }
+  bool server( callback handler, const char* path );
+  uint8_t index( void ) { return current_index; }
+  const coap_ingress_stats_t& stats( void ) { return counters; }
+
+  uint8_t begin( uint16_t port ) { return udp.begin( port ); }
+  void stop( void ) { udp.stop(); }
+  int beginPacket( IPAddress ip, uint16_t port ) { return udp.beginPacket( ip, port ); }
+  int beginPacket( const char* host, uint16_t port ) { return udp.beginPacket( host, port ); }
+  int endPacket( void ) { return udp.endPacket(); }
+  size_t write( uint8_t b ) { return udp.write( b ); }
+  size_t write( const uint8_t* buffer, size_t size ) { return udp.write( buffer, size ); }
+  int parsePacket( void );
+  int available( void ) { return current.length - pos; }
+  int read( void ) { return pos < current.length ? current.data[pos++] : -1; }
+  int read( unsigned char* buffer, size_t len );
+  int read( char* buffer, size_t len ) { return read( (unsigned char*)buffer, len ); }
+  int peek( void ) { return pos < current.length ? current.data[pos] : -1; }
+  void flush( void ) { pos = current.length; }
+  IPAddress remoteIP( void ) { return current.ip; }
+  uint16_t remotePort( void ) { return current.port; }
+
+ private:
+  struct datagram_t {
+    IPAddress ip;
+    uint16_t port;
+    uint8_t length;
+    uint8_t data[COAP_INGRESS_MTU];
+  };
+
+  UDP& udp;
+  datagram_t queue[COAP_INGRESS_SLOTS];  // oldest first
+  uint8_t depth;
+  datagram_t current;  // handed to Coap, also poll()'s receive buffer
+  uint8_t pos;
+  uint8_t allowance;
+  coap_ingress_stats_t counters;
+  const char* collection_name;
+  uint8_t current_index;
+
+  struct handler_t {
+    callback handler;
+    const char* path;
+  };
+  handler_t handlers[COAP_INGRESS_HANDLERS];
+  uint8_t handler_count;
+
+  static uint8_t type( const datagram_t& d ) { return ( d.data[0] >> 4 ) & 0x03; }
+  bool make_room( const datagram_t& incoming );
+  void remove( uint8_t i );
+  void reject( const datagram_t& d );
+  void route( datagram_t& d );
+  bool dispatch( datagram_t& d );
+};
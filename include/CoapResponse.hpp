@@ -0,0 +1,28 @@
+#pragma once
+
+#include <Arduino.h>
+#include <Udp.h>
+#include <coap.h>
+
+// Streams a response straight into a UDP packet, for replies that need
+// options Coap::sendResponse cannot carry (ETag, Max-Age...). The request
+// token is echoed. Options must be added in increasing number order.
+// Also builds requests of our own, without a token, and long payloads
+// can be written in pieces through body().
+class CoapResponse {
+ public:
+  CoapResponse( UDP& udp ) : udp( udp ){};
+  CoapResponse& begin( CoapPacket& request, IPAddress ip, int port, uint8_t code );
+  CoapResponse& begin( IPAddress ip, int port, uint8_t type, uint8_t code, uint16_t messageid );
+  CoapResponse& option( uint8_t number, const uint8_t* value, uint8_t length );
+  CoapResponse& option( uint8_t number, uint32_t value );
+  CoapResponse& payload( const uint8_t* data, uint16_t length );
+  Print& body( void );
+  int send( void );
+
+ private:
+  UDP& udp;
+  uint8_t last_option;
+
+  void header( uint16_t delta, uint16_t length );
+};
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <stdint.h>
+
+// Change detector, see sample(): residuals above DEADTIME_DRIFT cl are
+// summed, a sum above DEADTIME_THRESHOLD cl is a response
+#define DEADTIME_DRIFT 3
+#define DEADTIME_THRESHOLD 30
+
+// An edge the volume did not answer within this many ms is missed
+#define DEADTIME_TIMEOUT 30000
+
+// Measurements the median is taken over, per edge
+#ifndef DEADTIME_HISTORY
+#define DEADTIME_HISTORY 5
+#endif
+
+// Relay edges, each has its own estimate
+enum { DEADTIME_IN_ON, DEADTIME_IN_OFF, DEADTIME_OUT_ON, DEADTIME_OUT_OFF, DEADTIME_EDGES };
+
+struct deadtime_report_t {
+  uint16_t median_ms;  // 0 until measured
+  uint16_t last_ms;
+  uint8_t measured;    // since boot, saturates
+  uint8_t missed;      // timed out or cut by the next edge
+};
+
+// Delay between a pump relay edge and the volume answering it: valve,
+// pump and filter lag. edge() takes the command time and freezes the
+// volume trend at that time, sample() then watches the measured volume
+// leave that trend in the direction the edge implies. A CUSUM of the
+// residual detects the change, a line fitted over the rising part
+// dates it. Each edge keeps the median of its last DEADTIME_HISTORY
+// measurements. Arduino independent so it can be replayed on the host.
+class DeadTime {
+ public:
+  DeadTime& begin( int16_t drift = DEADTIME_DRIFT, int16_t threshold = DEADTIME_THRESHOLD );
+  void edge( int8_t pumping, uint32_t now, int16_t volume, int16_t flow );
+  void sample( int16_t measured, uint32_t t );
+  uint16_t median( uint8_t edge );
+  void report( uint8_t edge, deadtime_report_t& r );
+
+ private:
+  int16_t drift, threshold;
+  int8_t last_pumping;
+
+  // Measurement in progress
+  bool active;
+  uint8_t slot;
+  int8_t direction;     // sign of the expected volume change
+  uint32_t edge_time;   // ms
+  int16_t base_volume;  // cl at edge_time
+  int16_t base_flow;    // cl/s before the edge
+  int32_t cusum;
+
+  // Line fit over the samples since the CUSUM last left 0, t in ms
+  // from fit_origin, itself in ms from edge_time
+  int32_t fit_origin;
+  uint16_t fit_n;
+  float fit_t, fit_r, fit_tt, fit_tr;
+
+  // Results per edge, newest at history_head
+  uint16_t history[DEADTIME_EDGES][DEADTIME_HISTORY];
+  uint8_t history_head[DEADTIME_EDGES];
+  uint8_t measured[DEADTIME_EDGES];
+  uint8_t missed[DEADTIME_EDGES];
+
+  void restart_fit( int32_t origin );
+  void miss( void );
+  void store( uint16_t ms );
+};
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <Arduino.h>
+#include <avr/eeprom.h>
+#include <util/crc16.h>
+
+// Wear-levelled EEPROM store for one record type. Slots copies of T
+// are kept from address Base and every save() goes to the next slot,
+// so each cell only sees 1/Slots of the writes. A slot carries a
+// sequence number, a version and a CRC: load() returns the newest
+// intact copy of the expected version, and a write torn by a reset
+// only loses that write.
+//
+// Writes are staged in SRAM and poll() hands the EEPROM one byte at a
+// time when it is ready, instead of blocking about 3.4 ms per byte.
+template <class T, uint16_t Base, uint8_t Slots>
+class EepromRing {
+ public:
+  struct slot_t {
+    uint16_t seq;
+    uint8_t version;
+    T record;
+    uint16_t crc;  // over everything above
+  } __attribute__( ( packed ) );
+
+  static_assert( sizeof( slot_t ) < 256, "EepromRing records are limited to 250 bytes" );
+
+  EepromRing( void ) : pos( sizeof( slot_t ) ), writes( 0 ){};
+
+  // First address after the last slot
+  static const uint16_t end = Base + Slots * sizeof( slot_t );
+
+  // Newest valid copy into record, false if there is none
+  bool load( T& record, uint8_t version ) {
+    bool found = false;
+    uint16_t best_seq = 0;
+    uint8_t best = 0;
+    for ( uint8_t i = 0; i < Slots; i++ ) {
+      const uint8_t* addr = slot( i );
+      uint16_t crc = 0xFFFF;
+      for ( uint8_t j = 0; j < offsetof( slot_t, crc ); j++ ) {
+        crc = _crc_ccitt_update( crc, eeprom_read_byte( addr + j ) );
+      }
+      uint16_t stored, seq;
+      eeprom_read_block( &stored, addr + offsetof( slot_t, crc ), sizeof( stored ) );
+      eeprom_read_block( &seq, addr + offsetof( slot_t, seq ), sizeof( seq ) );
+      if ( stored != crc || eeprom_read_byte( addr + offsetof( slot_t, version ) ) != version ) {
+        continue;
+      }
+      if ( !found || (int16_t)( seq - best_seq ) > 0 ) {
+        found = true;
+        best_seq = seq;
+        best = i;
+      }
+    }
+    pos = sizeof( slot_t );
+    if ( !found ) {
+      next = 0;
+      image.seq = 0;
+      return false;
+    }
+    eeprom_read_block( &record, slot( best ) + offsetof( slot_t, record ), sizeof( T ) );
+    next = ( best + 1 ) % Slots;
+    image.seq = best_seq + 1;
+    return true;
+  }
+
+  // Queues record for writing. A write still in progress is restarted
+  // with the new record, in the same slot.
+  void save( const T& record, uint8_t version ) {
+    image.version = version;
+    image.record = record;
+    const uint8_t* p = (const uint8_t*)&image;
+    uint16_t crc = 0xFFFF;
+    for ( uint8_t j = 0; j < offsetof( slot_t, crc ); j++ ) {
+      crc = _crc_ccitt_update( crc, p[j] );
+    }
+    image.crc = crc;
+    pos = 0;
+    writes++;
+  }
+
+  // Writes the next staged byte if the EEPROM is idle. Returns true
+  // while a save() is still in progress.
+  bool poll( void ) {
+    if ( pos >= sizeof( slot_t ) ) {
+      return false;
+    }
+    if ( !eeprom_is_ready() ) {
+      return true;
+    }
+    eeprom_update_byte( (uint8_t*)slot( next ) + pos, ( (const uint8_t*)&image )[pos] );
+    if ( ++pos < sizeof( slot_t ) ) {
+      return true;
+    }
+    next = ( next + 1 ) % Slots;
+    image.seq++;
+    return false;
+  }
+
+  bool busy( void ) { return pos < sizeof( slot_t ); }
+  uint16_t saved( void ) { return writes; }
+
+ private:
+  slot_t image;
+  uint8_t next;
+  uint8_t pos;  // bytes of image already written
+  uint16_t writes;
+
+  static const uint8_t* slot( uint8_t i ) {
+    return (const uint8_t*)( Base + i * sizeof( slot_t ) );
+  }
+};
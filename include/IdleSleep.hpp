@@ -0,0 +1,42 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Time spent awake since the previous report
+struct idle_report_t {
+  uint16_t duty_permille;  // awake share of the window
+  uint16_t sleeps;         // times the CPU went to sleep
+  uint16_t longest_us;     // longest sleep
+  uint32_t window_ms;
+};
+
+// SLEEP_MODE_IDLE between loop() iterations. The CPU clock stops but
+// every peripheral keeps running, and any interrupt wakes it: the
+// Timer1 sample clock, TWI, the UART, pin changes enabled with
+// wake_on() or watched by PinEvents, and at the latest the Timer0
+// overflow behind millis(), every 1.024 ms. Polled peripherals (the
+// W5100) and the watchdog are therefore serviced at least once per
+// millisecond.
+//
+// sleep() is skipped when the iteration left work behind (hold()), or
+// when ready() says an interrupt already raised some, checked with
+// interrupts off so a wake-up cannot slip in before the sleep.
+class IdleSleep {
+ public:
+  IdleSleep& begin( bool ( *ready )( void ) = NULL );
+  IdleSleep& wake_on( uint8_t pin );
+  void hold( void ) { held = true; }
+  void sleep( void );
+  void report( idle_report_t& r );
+
+ private:
+  bool ( *ready )( void );
+  bool held;
+  uint32_t window_start;  // ms
+  uint32_t asleep_ms;
+  uint16_t asleep_us;     // below 1 ms, carried over
+  uint16_t sleeps;
+  uint16_t longest_us;
+};
+
+extern IdleSleep idle;
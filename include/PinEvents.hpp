@@ -0,0 +1,77 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Edges kept until loop() reads them, a power of 2
+#ifndef PIN_EVENTS_SIZE
+#define PIN_EVENTS_SIZE 16
+#endif
+
+// Pins watch() can take, one bit each in pin_event_t::pins
+#define PIN_EVENTS_PINS 8
+
+// Levels of the watched pins right after an edge
+struct pin_event_t {
+  uint16_t timestamp;  // millis(), low 16 bits
+  uint8_t pins;        // bit i: pin of the i-th watch()
+};
+
+// Captures pin edges in the pin change interrupts, so that none is lost
+// while loop() is busy in a conversion or on the network. Every edge
+// queues the levels of all watched pins with a timestamp in a single
+// producer, single consumer ring: the interrupt only moves head, pop()
+// only moves tail, no interrupt is masked to read it.
+//
+// PinEvents owns the three PCINT vectors. Pin changes enabled by
+// IdleSleep::wake_on() land here too and only wake the CPU.
+class PinEvents {
+ public:
+  PinEvents& watch( uint8_t pin, uint8_t mode );
+  bool pop( pin_event_t& e );
+  uint8_t pending( void ) { return ( head - tail ) & ( PIN_EVENTS_SIZE - 1 ); }
+  uint16_t dropped( void ) { return overflows; }
+  void capture( void );
+
+ private:
+  volatile uint8_t* in[PIN_EVENTS_PINS];
+  uint8_t mask[PIN_EVENTS_PINS];
+  uint8_t count;
+  uint8_t last;  // levels of the last queued edge
+
+  pin_event_t ring[PIN_EVENTS_SIZE];
+  volatile uint8_t head, tail;
+  volatile uint16_t overflows;
+
+  uint8_t levels( void );
+};
+
+extern PinEvents pin_events;
+
+// Quadrature decoder fed the encoder levels of every edge. Contact
+// bounce moves it back and forth and cancels out, a step is reported
+// every divider transitions in one direction.
+class Quadrature {
+ public:
+  Quadrature( uint8_t divider ) : divider( divider ), bits( 0 ), count( 0 ){};
+  int8_t update( bool a, bool b );  // 1, -1 or 0
+
+ private:
+  int8_t divider;
+  uint8_t bits;  // previous and current levels
+  int8_t count;
+};
+
+// A level counts once the pin has kept it for ms, after its last edge
+class Debounce {
+ public:
+  Debounce( uint16_t ms ) : ms( ms ), raw( false ), stable( false ){};
+  void sample( bool level, uint16_t timestamp );
+  bool update( uint16_t now );  // true when the stable level changed
+  bool level( void ) { return stable; }
+  uint16_t since( void ) { return changed_at; }  // time of that edge
+
+ private:
+  uint16_t ms;
+  bool raw, stable;
+  uint16_t changed_at;
+};
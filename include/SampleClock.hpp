@@ -0,0 +1,37 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Cadence statistics since the previous report
+struct sample_clock_report_t {
+  uint32_t period_us;   // mean interval between acquisitions
+  uint16_t jitter_us;   // peak to peak variation of that interval
+  uint16_t latency_us;  // longest delay from tick to acquisition
+  uint16_t missed;      // ticks that fired before the previous one was taken
+  uint16_t ticks;       // acquisitions
+};
+
+// Timer1 compare driven acquisition tick. The ISR only timestamps the
+// tick and raises a flag, the sampling itself (i2c) stays in loop(),
+// so the period is exact regardless of how long loop() takes.
+class SampleClock {
+ public:
+  SampleClock& begin( uint32_t period_us );
+  bool take( void );
+  bool due( void ) { return pending; }
+  uint32_t stamp( void ) { return taken_tick; }
+  void report( sample_clock_report_t& r );
+  void tick( void );
+
+ private:
+  volatile bool pending;
+  volatile uint32_t tick_at;
+  volatile uint16_t missed;
+  uint32_t taken_tick, first_taken;
+  uint32_t min_period, max_period;
+  uint16_t max_latency;
+  uint16_t ticks;
+};
+
+// There is one Timer1
+extern SampleClock sample_clock;
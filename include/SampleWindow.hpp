@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stdint.h>
+
+#ifndef SAMPLE_WINDOW_SIZE
+#define SAMPLE_WINDOW_SIZE 16
+#endif
+
+struct volume_sample_t {
+  uint32_t timestamp;  // millis()
+  int16_t code;        // raw ADC code (mean code when oversampling)
+  int16_t volume;      // cl
+};
+
+// Last SAMPLE_WINDOW_SIZE sensor samples with statistics kept up to date
+// in O(1) per sample: sliding Welford mean / variance, and monotonic
+// deques of ring indices for the window minimum and maximum.
+class SampleWindow {
+ public:
+  SampleWindow& begin( void );
+  void push( uint32_t timestamp, int16_t code, int16_t volume );
+
+  uint8_t count( void ) { return n; }
+  uint32_t total( void ) { return pushed; }
+  const volume_sample_t& at( uint8_t age );  // 0 is the newest
+  uint32_t span( void );                      // ms from oldest to newest
+  float mean( void ) { return w_mean; }
+  float variance( void ) { return n > 1 ? w_m2 / ( n - 1 ) : 0; }
+  int16_t minimum( void ) { return n ? ring[min_q[min_head]].volume : 0; }
+  int16_t maximum( void ) { return n ? ring[max_q[max_head]].volume : 0; }
+
+ private:
+  volume_sample_t ring[SAMPLE_WINDOW_SIZE];
+  uint8_t head, n;  // next slot to write, entries in use
+  uint32_t pushed;
+  float w_mean, w_m2;
+
+  // Ring indices, volumes increasing (min_q) or decreasing (max_q) from the front
+  uint8_t min_q[SAMPLE_WINDOW_SIZE], max_q[SAMPLE_WINDOW_SIZE];
+  uint8_t min_head, min_len, max_head, max_len;
+
+  static uint8_t wrap( uint8_t i ) { return i >= SAMPLE_WINDOW_SIZE ? i - SAMPLE_WINDOW_SIZE : i; }
+  void recompute( void );
+};
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <Arduino.h>
+
+#ifndef SCHEDULER_MAX_TASKS
+#define SCHEDULER_MAX_TASKS 8
+#endif
+
+// Id returned by add() when the table is full
+#define NO_TASK 0xFF
+
+// Priority 0 tasks run on every iteration whatever the budget
+#define TASK_CRITICAL 0
+
+// Readers of the task peaks, each resets only its own, see peak()
+#ifndef SCHEDULER_PEAK_READERS
+#define SCHEDULER_PEAK_READERS 2
+#endif
+
+typedef void ( *task_fn_t )( void );
+
+struct task_t {
+  task_fn_t run;
+  const char* name;
+  uint16_t budget_us;  // expected worst case of one run
+  uint8_t priority;    // lower runs first
+  bool skipped;        // skipped on the previous iteration
+  uint16_t peak_us[SCHEDULER_PEAK_READERS];  // longest run since that reader's last peak()
+  uint16_t overruns;   // runs that took longer than budget_us
+  uint16_t yields;     // iterations skipped for lack of budget
+};
+
+// Cooperative loop() scheduler. Tasks run in priority order; best-effort
+// tasks whose budget no longer fits in what is left of the iteration
+// budget yield to the next iteration. A task never yields twice in a
+// row, so the lowest priority still runs at least every other loop().
+class Scheduler {
+ public:
+  Scheduler& begin( uint16_t iteration_budget_us );
+  uint8_t add( task_fn_t run, const char* name, uint16_t budget_us, uint8_t priority );
+  void run( void );
+  uint8_t count( void ) { return n; }
+  const task_t& task( uint8_t id ) { return tasks[id]; }
+  uint16_t peak( uint8_t id, uint8_t reader, bool reset = true );
+  uint16_t loop_peak( bool reset = true );
+  uint32_t loops( void ) { return iterations; }
+  bool backlog( void ) { return deferred; }  // a task yielded in the last run()
+
+ private:
+  task_t tasks[SCHEDULER_MAX_TASKS];
+  uint8_t order[SCHEDULER_MAX_TASKS];  // task ids by priority
+  uint8_t n;
+  uint16_t budget_us;
+  uint16_t loop_peak_us;  // longest iteration since loop_peak(), bounds control latency
+  uint32_t iterations;
+  bool deferred;
+};
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <Arduino.h>
+#include <Udp.h>
+
+#include "CoapResponse.hpp"
+
+// Samples kept until the next push. A sample becomes four SenML
+// records, at most 160 bytes: 8 keep the datagram in one Ethernet frame.
+#ifndef SENML_BATCH_SIZE
+#define SENML_BATCH_SIZE 8
+#endif
+
+// application/senml+json, RFC 8428
+#define SENML_CONTENT_FORMAT 110
+
+// One tank at one time
+struct senml_sample_t {
+  uint32_t timestamp;  // millis()
+  uint8_t tank;
+  bool filling, transferring;
+  int16_t volume;  // cl
+  int16_t flow;    // cl/s
+};
+
+struct senml_stats_t {
+  uint16_t batches;  // datagrams sent
+  uint16_t samples;  // samples sent
+  uint16_t dropped;  // samples lost to a full batch
+  uint16_t errors;   // datagrams the network chip refused
+};
+
+// Pushes samples to a collector as SenML, one non-confirmable CoAP POST
+// per batch, instead of the collector polling /status. A batch goes out
+// every interval or as soon as it is full. The datagram is written to
+// the network chip one sample per poll() so that no loop() iteration
+// pays for the whole batch: it needs a UDP socket of its own.
+//
+// Record names are <tank>/volume (l), <tank>/flow (l/s), <tank>/filling
+// and <tank>/transferring, under the base name given to begin(). The
+// base time of each sample is relative to the send, in seconds.
+class SenmlPush {
+ public:
+  SenmlPush( UDP& udp ) : udp( udp ), message( udp ){};
+  SenmlPush& begin( const char* base_name, uint16_t messageid );
+  SenmlPush& collector( IPAddress ip, uint16_t port );
+  SenmlPush& interval( uint16_t seconds );
+  bool enabled( void ) { return port != 0; }
+  bool record( const senml_sample_t& s );
+  void poll( void );
+  const senml_stats_t& stats( void ) { return counters; }
+
+ private:
+  UDP& udp;
+  CoapResponse message;
+  const char* base_name;
+  IPAddress ip;
+  uint16_t port;  // 0: disabled
+  uint32_t interval_ms;
+  uint32_t last_push;
+  uint16_t messageid;
+
+  senml_sample_t batch[SENML_BATCH_SIZE];  // oldest first from head
+  uint8_t head, count;
+  uint8_t sending;  // samples of the datagram in progress still to write
+  uint8_t written;  // and already written
+  uint32_t sent_at;
+  senml_stats_t counters;
+
+  void start( void );
+  void write_sample( const senml_sample_t& s, bool first );
+};
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Painted over all free SRAM before main()
+#define SRAM_CANARY 0xC5
+
+// Bytes checked per scan() call
+#ifndef SRAM_SCAN_CHUNK
+#define SRAM_SCAN_CHUNK 64
+#endif
+
+// Call sites measured with probe_begin()/probe_end()
+#ifndef SRAM_PROBE_SLOTS
+#define SRAM_PROBE_SLOTS 14
+#endif
+
+// Heap layout right now
+struct sram_heap_t {
+  uint16_t used;       // __malloc_heap_start to __brkval, free chunks included
+  uint16_t free_list;  // bytes in freed chunks below __brkval
+  uint8_t fragments;   // freed chunks below __brkval
+  uint16_t largest;    // largest block malloc() could return
+};
+
+// SRAM high-water marks. Everything above .bss is painted with
+// SRAM_CANARY at boot, before the stack is set up. The stack grows down
+// over the paint, so the lowest overwritten byte above the heap is the
+// deepest the stack has been (ISRs included). scan() looks for it a
+// chunk at a time so it can run from loop() every iteration.
+//
+// probe_begin()/probe_end() measure the stack used by one call: the
+// free space under the stack pointer is repainted first, then scanned
+// afterwards. Both walk the free SRAM, a few hundred us each.
+class SramMonitor {
+ public:
+  SramMonitor& begin( void );
+  void scan( void );
+  uint16_t static_size( void );
+  uint16_t stack_peak( void );
+  uint16_t unused( void );
+  void heap( sram_heap_t& h );
+  void probe_begin( void );
+  void probe_end( uint8_t slot );
+  uint16_t probe_peak( uint8_t slot ) { return probes[slot]; }
+
+ private:
+  uint8_t* low;        // lowest byte the stack overwrote
+  uint8_t* cursor;     // where the next scan() resumes
+  uint8_t* heap_peak;  // highest top of heap seen
+  uint8_t* probe_sp;
+  uint16_t probes[SRAM_PROBE_SLOTS];
+
+  uint8_t* heap_top( void );
+  uint8_t* first_dirty( uint8_t* from, uint8_t* to );
+};
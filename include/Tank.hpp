@@ -0,0 +1,47 @@
+#pragma once
+
+#include <Automaton.h>
+#include "Atm_volume_sensor.hpp"
+#include "TankControl.hpp"
+
+// Relay pins of one tank
+struct tank_pins_t {
+  uint8_t water_in;
+  uint8_t water_out;
+};
+
+// Settings of one tank kept in EEPROM
+struct tank_config_t {
+  volume_calibration_t calibration;
+  int16_t max_volume;
+};
+
+// One vessel: its pressure transmitter on an ADS1115 input, volume
+// filtering, the pump relays and the fill / transfer state. control
+// decides which pump runs, poll() applies it to the flags. dead_time
+// learns how long the volume takes to answer each relay edge, and the
+// sensor zero follows the drift of the transmitter. Everything is a
+// member, tanks are plain globals.
+class Tank {
+ public:
+  Atm_volume_sensor sensor;
+  SampleWindow window;
+  VolumeEstimator estimator;
+  DeadTime dead_time;
+  Atm_bit filling, transferring;
+  Atm_led water_in_relay, water_out_relay;
+  TankControl control;
+
+  Tank& begin( uint8_t channel, const tank_pins_t& pins, const tank_config_t& config, uint8_t oversample );
+  Tank& configure( const tank_config_t& config );
+  bool fill( int target );
+  bool transfer( int amount );
+  void stop_filling( void );
+  void stop_transferring( void );
+  bool zero( uint8_t source );
+  void poll( void );
+  int volume( void ) { return sensor.state(); }
+
+ private:
+  void apply( void );
+};
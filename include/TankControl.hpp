@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stdint.h>
+#include "SampleWindow.hpp"
+
+// Empty, for the transfer and the zero alike: a transfer stops below
+// TANK_EMPTY cl, the pump would run dry, and the tank it leaves is
+// re-zeroed to read 0 cl (see VolumeConversion::zero_at())
+#define TANK_EMPTY 10  // cl
+
+// Changes of at most this many cl are not pushed by the sensor
+#define VOLUME_DEADBAND 5
+
+// Auto-zero: a transfer stopped within AUTOZERO_EMPTY cl of empty, by
+// TANK_EMPTY or by hand when a drifted zero kept the level above it,
+// leaves the tank at the level the pump drains it to. Once the pumps
+// have been idle AUTOZERO_SETTLE ms, the level steady and still within
+// AUTOZERO_EMPTY cl of 0, the zero is learned from the samples. 100 cl
+// is about 900 codes with the default calibration, within
+// ZERO_TRIM_LIMIT.
+#define AUTOZERO_SETTLE 10000  // ms
+#define AUTOZERO_EMPTY 100     // cl
+#define AUTOZERO_FLOW 5        // cl/s
+#define AUTOZERO_MAX_SD 5      // cl
+
+// The fill / transfer rules of a tank, without the relays: which pump
+// runs, when it stops, and when the tank is drained enough to re-zero.
+// Tank applies them to its Atm_bits, tools/replay.cpp to a field trace.
+// Arduino independent so it can be replayed on the host.
+class TankControl {
+ public:
+  int fill_target;  // dL
+  int tx_amount;
+  int max_volume;
+
+  void begin( int max_volume );
+  bool fill_valid( int target ) { return target > 0 && target < max_volume; }
+  bool transfer_valid( int amount, int volume ) { return amount > 0 && amount < volume; }
+  bool fill( int target );
+  bool transfer( int amount, int volume );
+  void stop_filling( void );
+  void stop_transferring( void );
+  bool run( int volume, int flow, uint32_t now, SampleWindow& window );
+  int8_t pumping( void ) { return pump; }  // 1 filling, -1 transferring, 0 idle
+
+ private:
+  int8_t pump, last_pump;
+  bool drained;
+  uint32_t drained_at;
+};
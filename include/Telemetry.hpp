@@ -0,0 +1,56 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Ring buffer size for encoded frames, must be a power of two
+#ifndef TELEMETRY_BUFFER_SIZE
+#define TELEMETRY_BUFFER_SIZE 128
+#endif
+
+// Record types, first byte of every record
+enum { TELEMETRY_SAMPLE = 1 };
+
+// Loop phases timed in each sample record
+enum { PHASE_OUTPUT, PHASE_COAP, PHASE_RUN, PHASE_COUNT };
+
+// Periodic sample, little-endian as laid out in memory on AVR.
+// Keep in sync with tools/telemetry_decode.py
+struct telemetry_sample_t {
+  uint8_t type;
+  uint8_t seq;
+  uint32_t timestamp;              // millis()
+  int16_t code;                    // latest raw ADC code
+  int16_t volume;                  // filtered volume, cl
+  uint8_t relays;                  // bit 0: filling, 1: transferring, 2: in relay pin, 3: out relay pin,
+                                   // 4-6: PGA range of code, 0: 6144 mV to 5: 256 mV,
+                                   // 7: DHCP failed at boot
+  uint16_t phase[PHASE_COUNT];     // longest loop() phase since previous record, us
+  uint16_t stack_peak;             // deepest stack since boot, bytes
+  uint16_t sram_unused;            // SRAM never reached by heap or stack, bytes
+} __attribute__( ( packed ) );
+
+// Non-blocking binary telemetry: records are COBS framed (0x00 delimited)
+// into a ring buffer, and drain() only hands the UART as many bytes as
+// its TX buffer can take without blocking. Records that do not fit are
+// dropped whole, the sequence number lets the host see the gap.
+class Telemetry {
+ public:
+  Telemetry& begin( HardwareSerial& port, uint16_t interval );
+  bool due( void );
+  bool send( void* record, uint8_t len );
+  void drain( void );
+  uint8_t next_seq( void ) { return seq++; }
+  uint16_t dropped( void ) { return drops; }
+
+ private:
+  HardwareSerial* port;
+  uint16_t interval;
+  uint32_t last;
+  uint8_t seq;
+  uint16_t drops;
+  uint8_t buf[TELEMETRY_BUFFER_SIZE];
+  uint8_t head, tail;
+
+  uint8_t used( void ) { return ( head - tail ) & ( TELEMETRY_BUFFER_SIZE - 1 ); }
+  void put( uint8_t b );
+};
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Text renderer for 8x8 tile displays (U8x8) that only sends the tiles
+// whose character changed since the previous frame. A frame is drawn
+// between begin_frame() and end_frame(); rows that were not written in
+// the frame are blanked. Call invalidate() when something else (the menu,
+// a clear()) drew over the display.
+template <class Display, uint8_t Cols, uint8_t Rows>
+class TileText {
+ public:
+  TileText( Display& display ) : display( display ){};
+
+  void invalidate( void ) {
+    display.clear();
+    memset( shadow, ' ', sizeof( shadow ) );
+  }
+
+  void begin_frame( void ) {
+    touched = 0;
+  }
+
+  // Draws text on a row, padded with blanks up to the last column
+  void row( uint8_t y, const char* text, uint8_t x = 0 ) {
+    for ( uint8_t i = 0; i < x; i++ ) {
+      put( i, y, ' ' );
+    }
+    for ( ; x < Cols; x++ ) {
+      put( x, y, *text ? *text++ : ' ' );
+    }
+    touched |= 1 << y;
+  }
+
+  void end_frame( void ) {
+    for ( uint8_t y = 0; y < Rows; y++ ) {
+      if ( !( touched & ( 1 << y ) ) ) {
+        row( y, "" );
+      }
+    }
+  }
+
+ private:
+  Display& display;
+  char shadow[Rows][Cols];
+  uint8_t touched;
+
+  void put( uint8_t x, uint8_t y, char c ) {
+    if ( shadow[y][x] != c ) {
+      shadow[y][x] = c;
+      display.drawGlyph( x, y, c );
+    }
+  }
+};
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <stdint.h>
+#include "DeadTime.hpp"
+#include "SampleWindow.hpp"
+#include "VolumeEstimator.hpp"
+
+// Pressure transmitter and tank geometry, see calibrate()
+struct volume_calibration_t {
+  uint16_t full_scale_mv;   // ADS1115 PGA range: 6144, 4096, 2048, 1024, 512, 256, or 0 to auto-range
+  uint16_t zero_mv;         // transmitter output at 0 Pa
+  uint16_t span_mv;         // transmitter output at span_pascal
+  uint16_t span_pascal;
+  uint16_t tank_radius_mm;
+  int16_t volume_offset;    // cl
+};
+
+extern const volume_calibration_t volume_calibration_default;
+
+// Largest zero trim, in 7.8125 uV codes (20 mV): a bigger offset is not
+// drift, the tank was not empty or the reference is off
+#define ZERO_TRIM_LIMIT 2560
+
+// How the zero trim was last set
+enum { ZERO_CALIBRATED, ZERO_EMPTY, ZERO_COMMAND, ZERO_REFERENCE, ZERO_RESTORED };
+
+// ADS1115 PGA ranges, widest first
+#define PGA_RANGES 6
+
+// Conversions dropped after a gain or input switch: reads queued
+// behind the config write can still return the previous conversion
+#define PGA_SETTLE 2
+
+// What take() leaves to the caller
+#define TAKE_SAMPLE 0x01  // new output sample in volume()
+#define TAKE_CONFIG 0x02  // range or input changed, write the ADC config
+#define TAKE_PASS 0x04    // output sample complete, the ADC can move on
+
+// Everything between an ADS1115 code and the published volume, without
+// the bus: PGA auto-ranging, oversampling, the conversion to cl with
+// its zero trim, then the sample window, dead-time detector and
+// estimator, and the deadband. Atm_volume_sensor feeds it the codes it
+// reads, tools/replay.cpp those of a field trace. Arduino independent
+// so it can be replayed on the host.
+class VolumeConversion {
+ public:
+  static bool calibration_valid( const volume_calibration_t& c );
+  bool calibrate( const volume_calibration_t& c );
+  void oversample( uint8_t shift );
+  void period( uint16_t ms, bool restart = false );
+  void average( uint16_t* v, uint16_t size );
+  void window( SampleWindow* w ) { sample_window = w; }
+  void deadtime( DeadTime* d ) { dead_time = d; }
+  void estimate( VolumeEstimator* e );
+  void warm( const estimator_state_t& s );
+  void threshold( int v ) { v_threshold = v; }
+
+  bool trim( int16_t codes, uint8_t source );
+  bool zero_at( int measured, uint8_t source );
+  bool zero( uint8_t source );
+  bool reference( void );
+
+  void settle( void ) { settling = PGA_SETTLE; }
+  uint8_t take( bool ok, int16_t code, uint32_t now, int8_t pumping );
+  int convert( int32_t codes, uint8_t shift );
+
+  // Deadband: due() when the output moved more than the threshold since
+  // the last sent()
+  bool due( void );
+  void sent( void );
+  int published( void ) { return v_published; }
+
+  int volume( void ) { return v_sample; }
+  int flow( void );
+  int16_t code( void ) { return v_code; }
+  uint8_t range( void ) { return pga_index; }
+  uint16_t full_scale( void );
+  uint8_t lsb( void );
+  uint8_t shift( void ) { return os_shift; }
+  int16_t zero_trim( void ) { return trim_codes; }
+  uint8_t zero_source( void ) { return trim_source; }
+  bool referencing( void ) { return ref_pending; }
+
+ private:
+  SampleWindow* sample_window;
+  DeadTime* dead_time;
+  VolumeEstimator* estimator;
+  uint16_t period_ms;  // between two output samples
+  int v_sample, v_threshold, v_published;
+  bool v_fresh;
+  int16_t v_code;
+  uint8_t settling;  // conversions left to drop
+
+  // Boxcar average of the output, see average()
+  uint16_t* avg_buf;
+  uint16_t avg_buf_size;
+  uint16_t avg_buf_head;
+  uint32_t avg_buf_total;
+
+  // Oversampling: sum of raw codes over (1 << os_shift) conversions
+  uint8_t os_shift;
+  uint16_t os_count;
+  uint32_t os_first;  // time of the first of them
+  bool os_error;
+  int32_t os_total;
+
+  // Integer conversion, see calibrate(). zero_code includes the trim.
+  int32_t zero_code, cl_per_code_q20;
+  int16_t volume_offset;
+
+  // Zero drift, see trim() and reference()
+  int16_t trim_codes;
+  uint8_t trim_source;
+  bool ref_pending;
+  bool last_ok;
+  int32_t last_scaled;  // mean scaled code of the last output sample
+
+  // PGA range index, widest first, and auto-ranging state
+  uint8_t pga_index;
+  bool autoranging;
+  int32_t os_peak;  // largest scaled code since the last narrow()
+
+  void select( uint8_t r );
+  bool narrow( void );
+  void reference_done( bool ok, int32_t diff );
+  int avg( int v );
+  int publish( uint32_t now, int16_t code, int v, int8_t pumping );
+};
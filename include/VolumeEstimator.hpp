@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stdint.h>
+
+// Alpha-beta gains in Q12, a steady-state Kalman filter for a constant
+// flow model: beta = alpha^2 / (2 - alpha)
+#define ESTIMATOR_ALPHA 512  // 0.125
+#define ESTIMATOR_BETA 34    // 0.0083
+
+// A restored state further than this from the first measurement, in cl,
+// is stale and dropped
+#define ESTIMATOR_WARM_GATE 100
+
+// What restore() needs to resume, kept across resets
+struct estimator_state_t {
+  int32_t x;                        // cl, Q8
+  int32_t learned_in, learned_out;  // cl per sample, Q8
+};
+
+// Two-state (volume, flow) fixed-point estimator. Pump state is the
+// control input: with both pumps off the volume is known to be flat, a
+// running pump constrains the flow sign, and on every pump edge the flow
+// is restarted from what that pump achieved the last time it ran.
+// Arduino independent so it can be benchmarked on the host.
+class VolumeEstimator {
+ public:
+  VolumeEstimator& begin( uint16_t period_ms, int16_t alpha = ESTIMATOR_ALPHA, int16_t beta = ESTIMATOR_BETA );
+  int16_t update( int16_t measured, int8_t pumping );
+  int16_t volume( void ) { return ( x + 128 ) >> 8; }
+  int16_t flow( void );  // cl/s
+  VolumeEstimator& period( uint16_t ms ) {
+    period_ms = ms;
+    return *this;
+  }
+  void save( estimator_state_t& s );
+  VolumeEstimator& restore( const estimator_state_t& s );
+
+ private:
+  int32_t x, v;                     // cl and cl per sample, Q8
+  int32_t learned_in, learned_out;  // flow of each pump when it last stopped, Q8
+  int16_t alpha, beta;
+  uint16_t period_ms;
+  int8_t last_pumping;
+  bool primed;
+  bool warm;  // restored, first measurement not seen yet
+};
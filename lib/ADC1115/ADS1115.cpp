@@ -14,10 +14,12 @@
 #include "WProgram.h"
 #endif
 
-#include <Wire.h>
-
 #include "ADS1115.h"
 
+#ifdef ADS1115_WIRE
+
+#include <Wire.h>
+
 /**************************************************************************/
 /*
         Abstract away platform differences in Arduino wire library
@@ -558,3 +560,5 @@ int16_t ADS1115::Comparator_Differential(uint8_t channel)
     uint16_t raw_adc = readRegister(ads_i2cAddress, ADS1115_REG_POINTER_CONVERT);
     return (int16_t)raw_adc;
 }
+
+#endif // ADS1115_WIRE
@@ -8,14 +8,15 @@
 */
 /**************************************************************************/
 
+#ifndef ADS1115_H
+#define ADS1115_H
+
 #if ARDUINO >= 100
 #include "Arduino.h"
 #else
 #include "WProgram.h"
 #endif
 
-#include <Wire.h>
-
 /**************************************************************************
     I2C ADDRESS/BITS
 **************************************************************************/
@@ -159,6 +160,17 @@ typedef enum
     COMPQUE_NONE        = ADS1115_REG_CONFIG_CQUE_NONE
 } adsCompQue_t;
 
+/**************************************************************************/
+/*
+        Blocking driver on Wire, only built with ADS1115_WIRE. The firmware
+        reads through ADS1115Static on TwiQueue, which owns the TWI
+        peripheral, so the two cannot be linked together.
+*/
+/**************************************************************************/
+#ifdef ADS1115_WIRE
+
+#include <Wire.h>
+
 class ADS1115
 {
     protected:
@@ -207,3 +219,7 @@ class ADS1115
 
     private:
 };
+
+#endif // ADS1115_WIRE
+
+#endif
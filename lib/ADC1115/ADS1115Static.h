@@ -0,0 +1,148 @@
+/**************************************************************************/
+/*
+        ADS1115Static
+        Compile-time configured variant of the ADS1115 driver.
+        Address, gain, data rate, operating mode and comparator settings
+        are template parameters, so every config word is a constant folded
+        by the compiler (or a PROGMEM table when the channel is only known
+        at run time) and an instance holds no state in SRAM.
+        Only the members that are actually called get instantiated.
+*/
+/**************************************************************************/
+
+#ifndef ADS1115STATIC_H
+#define ADS1115STATIC_H
+
+#if ARDUINO >= 100
+#include "Arduino.h"
+#else
+#include "WProgram.h"
+#endif
+
+#include "ADS1115.h"
+#include "TwiQueue.h"
+
+template <uint8_t Addr,
+          adsGain_t Gain = GAIN_TWO,
+          adsRate_t Rate = RATE_128,
+          adsMode_t Mode = MODE_SINGLE,
+          adsCompQue_t CompQue = COMPQUE_NONE,
+          adsCompMode_t CompMode = COMPMODE_TRAD,
+          adsCompPol_t CompPol = COMPPOL_LOW,
+          adsCompLat_t CompLat = COMPLAT_NONLAT>
+class ADS1115Static
+{
+    public:
+        static const uint8_t i2cAddress = Addr;
+
+        // Every config bit except the input multiplexer
+        static constexpr uint16_t base_config =
+            ADS1115_REG_CONFIG_OS_SINGLE | Gain | Mode | Rate |
+            CompMode | CompPol | CompLat | CompQue;
+
+        static constexpr uint16_t samples_per_second =
+            Rate == RATE_8   ? 8   :
+            Rate == RATE_16  ? 16  :
+            Rate == RATE_32  ? 32  :
+            Rate == RATE_64  ? 64  :
+            Rate == RATE_128 ? 128 :
+            Rate == RATE_250 ? 250 :
+            Rate == RATE_475 ? 475 : 860;
+
+        // Time for one conversion at Rate, in mS, rounded up
+        static constexpr uint8_t conversion_delay = 1000 / samples_per_second + 1;
+
+        // Config word for single-ended input AIN<channel>
+        template <uint8_t channel>
+        static constexpr uint16_t singleConfig()
+        {
+            static_assert(channel < 4, "ADS1115 has 4 single-ended inputs");
+            return base_config | (ADS1115_REG_CONFIG_MUX_SINGLE_0 + ((uint16_t)channel << 12));
+        }
+
+        // Config word for differential pair 01, 03, 13 or 23 (as Measure_Differential)
+        template <uint8_t pair>
+        static constexpr uint16_t differentialConfig()
+        {
+            static_assert(pair == 01 || pair == 03 || pair == 13 || pair == 23,
+                          "ADS1115 differential pairs are 01, 03, 13 and 23");
+            return base_config | (pair == 01 ? ADS1115_REG_CONFIG_MUX_DIFF_0_1 :
+                                  pair == 03 ? ADS1115_REG_CONFIG_MUX_DIFF_0_3 :
+                                  pair == 13 ? ADS1115_REG_CONFIG_MUX_DIFF_1_3 :
+                                               ADS1115_REG_CONFIG_MUX_DIFF_2_3);
+        }
+
+        /**************************************************************************/
+        /*
+                Every transfer is queued on TwiQueue: the calls return as
+                soon as the transaction is in the pool, done(t, context)
+                runs from twi.poll() with t.status and the result. A read
+                sets the pointer itself, so config writes and reads can be
+                queued in any order.
+        */
+        /**************************************************************************/
+        static bool queueConfig(uint16_t config, twi_done_t done = NULL, void* context = NULL)
+        {
+            uint8_t tx[3] = { ADS1115_REG_POINTER_CONFIG, (uint8_t)(config >> 8), (uint8_t)(config & 0xFF) };
+            return twi.submit(Addr, tx, sizeof(tx), 0, done, context);
+        }
+
+        template <uint8_t channel>
+        static bool queueSingleEnded(adsGain_t gain, twi_done_t done = NULL, void* context = NULL)
+        {
+            return queueConfig((singleConfig<channel>() & ~ADS1115_REG_CONFIG_PGA_MASK) | gain, done, context);
+        }
+
+        // Run-time channel selection, config words come from flash
+        static bool queueSingleEnded(uint8_t channel, adsGain_t gain, twi_done_t done = NULL, void* context = NULL)
+        {
+            if (channel > 3)
+                return false;
+            return queueConfig((pgm_read_word(&single_configs[channel]) & ~ADS1115_REG_CONFIG_PGA_MASK) | gain, done, context);
+        }
+
+        // Differential pair 01, 03, 13 or 23, as Measure_Differential()
+        static bool queueDifferential(uint8_t pair, adsGain_t gain, twi_done_t done = NULL, void* context = NULL)
+        {
+            uint8_t i;
+            switch (pair)
+            {
+                case (01): i = 0; break;
+                case (03): i = 1; break;
+                case (13): i = 2; break;
+                case (23): i = 3; break;
+                default: return false;
+            }
+            return queueConfig((pgm_read_word(&differential_configs[i]) & ~ADS1115_REG_CONFIG_PGA_MASK) | gain, done, context);
+        }
+
+        static bool queueRead(twi_done_t done, void* context = NULL)
+        {
+            uint8_t tx[1] = { ADS1115_REG_POINTER_CONVERT };
+            return twi.submit(Addr, tx, sizeof(tx), 2, done, context);
+        }
+
+        // Conversion register of a finished queueRead()
+        static int16_t result(const twi_transaction_t& t)
+        {
+            return (int16_t)((t.rx[0] << 8) | t.rx[1]);
+        }
+
+    private:
+        static const uint16_t single_configs[4];
+        static const uint16_t differential_configs[4];
+};
+
+template <uint8_t Addr, adsGain_t Gain, adsRate_t Rate, adsMode_t Mode,
+          adsCompQue_t CompQue, adsCompMode_t CompMode, adsCompPol_t CompPol, adsCompLat_t CompLat>
+const uint16_t ADS1115Static<Addr, Gain, Rate, Mode, CompQue, CompMode, CompPol, CompLat>::single_configs[4] PROGMEM = {
+    singleConfig<0>(), singleConfig<1>(), singleConfig<2>(), singleConfig<3>()
+};
+
+template <uint8_t Addr, adsGain_t Gain, adsRate_t Rate, adsMode_t Mode,
+          adsCompQue_t CompQue, adsCompMode_t CompMode, adsCompPol_t CompPol, adsCompLat_t CompLat>
+const uint16_t ADS1115Static<Addr, Gain, Rate, Mode, CompQue, CompMode, CompPol, CompLat>::differential_configs[4] PROGMEM = {
+    differentialConfig<01>(), differentialConfig<03>(), differentialConfig<13>(), differentialConfig<23>()
+};
+
+#endif
@@ -0,0 +1,175 @@
+#include "TwiQueue.h"
+
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+#include <util/twi.h>
+
+TwiQueue twi;
+
+ISR( TWI_vect ) {
+  twi.isr();
+}
+
+// TWCR to go on with the next bus step, interrupt enabled
+#define TWCR_GO ( _BV( TWINT ) | _BV( TWEN ) | _BV( TWIE ) )
+
+TwiQueue& TwiQueue::begin( uint32_t clock ) {
+  head = count = active = queued = 0;
+  busy = false;
+  memset( &counters, 0, sizeof( counters ) );
+  // Internal pull-ups, as Wire does
+  digitalWrite( SDA, HIGH );
+  digitalWrite( SCL, HIGH );
+  TWSR = 0;  // prescaler 1
+  TWBR = ( F_CPU / clock - 16 ) / 2;
+  TWCR = _BV( TWEN );
+  return *this;
+}
+
+// Returns false, without queueing anything, when the pool is full
+bool TwiQueue::submit( uint8_t address, const uint8_t* tx, uint8_t tx_len, uint8_t rx_len,
+                       twi_done_t done, void* context ) {
+  if ( count == TWI_QUEUE_SIZE || tx_len > TWI_MAX_TX || rx_len > TWI_MAX_RX ) {
+    counters.rejected++;
+    return false;
+  }
+  twi_transaction_t& t = pool[( head + count ) % TWI_QUEUE_SIZE];
+  t.address = address;
+  memcpy( t.tx, tx, tx_len );
+  t.tx_len = tx_len;
+  t.rx_len = rx_len;
+  t.status = TWI_PENDING;
+  t.done = done;
+  t.context = context;
+  count++;
+  ATOMIC_BLOCK( ATOMIC_RESTORESTATE ) {
+    queued++;
+    if ( !busy ) {
+      start( TWCR_GO | _BV( TWSTA ) );
+    }
+  }
+  return true;
+}
+
+// Begins pool[active] with a start (or repeated start) condition
+void TwiQueue::start( uint8_t twcr ) {
+  busy = true;
+  reading = false;
+  pos = 0;
+  started = micros();
+  TWCR = twcr;
+}
+
+void TwiQueue::retire( uint8_t status ) {
+  pool[active].status = status;
+  active = ( active + 1 ) % TWI_QUEUE_SIZE;
+  queued--;
+}
+
+// Called from the interrupt. Chains the next queued transaction with a
+// repeated start, or releases the bus.
+void TwiQueue::finish( uint8_t status ) {
+  retire( status );
+  if ( queued > 0 && status != TWI_BUS_ERROR ) {
+    start( TWCR_GO | _BV( TWSTA ) );
+    return;
+  }
+  // A start written before the stop is out would be lost. That takes a
+  // few us, unless a device holds SDA low: the next transaction then
+  // times out and resets the peripheral.
+  TWCR = TWCR_GO | _BV( TWSTO );
+  for ( uint8_t spin = 0xFF; spin > 0 && ( TWCR & _BV( TWSTO ) ); spin-- ) {
+  }
+  busy = false;
+}
+
+void TwiQueue::isr( void ) {
+  twi_transaction_t& t = pool[active];
+  switch ( TW_STATUS ) {
+    case TW_START:
+    case TW_REP_START:
+      TWDR = ( t.address << 1 ) | ( reading || t.tx_len == 0 ? TW_READ : TW_WRITE );
+      if ( t.tx_len == 0 ) {
+        reading = true;
+      }
+      TWCR = TWCR_GO;
+      return;
+    case TW_MT_SLA_ACK:
+    case TW_MT_DATA_ACK:
+      if ( pos < t.tx_len ) {
+        TWDR = t.tx[pos++];
+        TWCR = TWCR_GO;
+      } else if ( t.rx_len > 0 ) {
+        reading = true;
+        pos = 0;
+        TWCR = TWCR_GO | _BV( TWSTA );
+      } else {
+        finish( TWI_DONE );
+      }
+      return;
+    case TW_MR_SLA_ACK:
+      // ACK every byte but the last
+      TWCR = t.rx_len > 1 ? TWCR_GO | _BV( TWEA ) : TWCR_GO;
+      return;
+    case TW_MR_DATA_ACK:
+      t.rx[pos++] = TWDR;
+      TWCR = pos + 1 < t.rx_len ? TWCR_GO | _BV( TWEA ) : TWCR_GO;
+      return;
+    case TW_MR_DATA_NACK:
+      t.rx[pos++] = TWDR;
+      finish( TWI_DONE );
+      return;
+    case TW_MT_SLA_NACK:
+    case TW_MT_DATA_NACK:
+    case TW_MR_SLA_NACK:
+      finish( TWI_NACK );
+      return;
+    default:  // bus error, lost arbitration
+      finish( TWI_BUS_ERROR );
+      return;
+  }
+}
+
+// Aborts a transaction past its timeout, restarts the bus after an
+// error, and runs the callbacks of finished transactions. Returns the
+// number of transactions still in use.
+uint8_t TwiQueue::poll( void ) {
+  ATOMIC_BLOCK( ATOMIC_RESTORESTATE ) {
+    if ( busy && micros() - started > TWI_TIMEOUT_US ) {
+      // Disabling the peripheral releases the lines
+      TWCR = 0;
+      TWCR = _BV( TWEN );
+      retire( TWI_TIMEOUT );
+      busy = false;
+    }
+    // Transactions left behind by an error or a timeout
+    if ( !busy && queued > 0 ) {
+      start( TWCR_GO | _BV( TWSTA ) );
+    }
+  }
+  while ( count > 0 && pool[head].status != TWI_PENDING ) {
+    twi_transaction_t& t = pool[head];
+    switch ( t.status ) {
+      case TWI_DONE: counters.done++; break;
+      case TWI_TIMEOUT: counters.timeouts++; break;
+      default: counters.errors++; break;
+    }
+    if ( t.done ) {
+      t.done( t, t.context );
+    }
+    head = ( head + 1 ) % TWI_QUEUE_SIZE;
+    count--;
+  }
+  return count;
+}
+
+// Blocks until every queued transaction finished, for setup()
+bool TwiQueue::flush( uint16_t timeout_ms ) {
+  uint32_t since = millis();
+  while ( poll() > 0 ) {
+    if ( millis() - since > timeout_ms ) {
+      return false;
+    }
+  }
+  return true;
+}
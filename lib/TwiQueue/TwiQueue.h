@@ -0,0 +1,88 @@
+#pragma once
+
+#include <Arduino.h>
+
+// The legacy ADS1115 driver reads through Wire, see TwiQueue below
+#ifdef ADS1115_WIRE
+#error "ADS1115_WIRE links Wire, which TwiQueue replaces"
+#endif
+
+// Transactions in flight or waiting for their callback
+#ifndef TWI_QUEUE_SIZE
+#define TWI_QUEUE_SIZE 4
+#endif
+
+// Largest register write and read, enough for 16-bit registers
+#define TWI_MAX_TX 3
+#define TWI_MAX_RX 2
+
+// A transaction still on the bus after this is aborted
+#ifndef TWI_TIMEOUT_US
+#define TWI_TIMEOUT_US 2000
+#endif
+
+enum { TWI_PENDING, TWI_DONE, TWI_NACK, TWI_BUS_ERROR, TWI_TIMEOUT };
+
+struct twi_transaction_t;
+
+typedef void ( *twi_done_t )( const twi_transaction_t& t, void* context );
+
+// Writes tx, then reads rx_len bytes after a repeated start
+struct twi_transaction_t {
+  uint8_t address;
+  uint8_t tx[TWI_MAX_TX];
+  uint8_t tx_len;
+  uint8_t rx[TWI_MAX_RX];
+  uint8_t rx_len;
+  volatile uint8_t status;
+  twi_done_t done;
+  void* context;
+};
+
+struct twi_stats_t {
+  uint16_t done;
+  uint16_t errors;    // NACK or bus error
+  uint16_t timeouts;
+  uint16_t rejected;  // submit() with the pool full
+};
+
+// Interrupt driven TWI master. submit() copies the transaction into a
+// fixed pool and returns at once; the TWI interrupt moves it over the
+// bus byte by byte and chains queued transactions with repeated starts.
+// Callbacks run from poll() in loop(), in submission order, never from
+// the interrupt. poll() also aborts a transaction stuck for longer than
+// TWI_TIMEOUT_US and resets the peripheral.
+//
+// Owns the TWI peripheral and its vector, so Wire must not be linked in
+// the same firmware.
+class TwiQueue {
+ public:
+  TwiQueue& begin( uint32_t clock = 100000 );
+  bool submit( uint8_t address, const uint8_t* tx, uint8_t tx_len, uint8_t rx_len,
+               twi_done_t done = NULL, void* context = NULL );
+  uint8_t poll( void );
+  bool flush( uint16_t timeout_ms );
+  uint8_t pending( void ) { return count; }
+  bool ready( void ) { return count > queued; }  // callbacks waiting for poll()
+  const twi_stats_t& stats( void ) { return counters; }
+  void isr( void );
+
+ private:
+  twi_transaction_t pool[TWI_QUEUE_SIZE];
+  uint8_t head;              // oldest descriptor in use
+  uint8_t count;             // descriptors in use, finished or not
+  volatile uint8_t active;   // descriptor on the bus
+  volatile uint8_t queued;   // descriptors not finished yet
+  volatile bool busy;
+  volatile bool reading;     // past the repeated start
+  volatile uint8_t pos;      // next tx or rx byte
+  volatile uint32_t started;
+  twi_stats_t counters;
+
+  void start( uint8_t twcr );
+  void retire( uint8_t status );
+  void finish( uint8_t status );
+};
+
+// There is one TWI peripheral
+extern TwiQueue twi;
@@ -1,49 +1,46 @@
 #include "Atm_volume_sensor.hpp"
 
-Atm_volume_sensor& Atm_volume_sensor::begin(int samplerate /* = 50 */) {
+Atm_volume_sensor* Atm_volume_sensor::scan_owner;
+uint8_t Atm_volume_sensor::scan_size;
+
+// Every sensor begun joins the scan of the ADC inputs: the owner keeps
+// the multiplexer on its channel for one output sample, then hands it
+// to the next sensor, which drops PGA_SETTLE conversions first. With a
+// single sensor the ADC never switches.
+Atm_volume_sensor& Atm_volume_sensor::begin(int samplerate /* = 50 */, uint8_t channel /* = 0 */) {
     const static state_t state_table[] PROGMEM = {
       /*              ON_ENTER    ON_LOOP  ON_EXIT  EVT_TRIGGER  EVT_TIMER   ELSE */
-      /* IDLE   */          -1,        -1,      -1,          -1,   SAMPLE,    -1,
+      /* IDLE   */          -1,        -1,      -1,        SEND,   SAMPLE,    -1,
       /* SAMPLE */  ENT_SAMPLE,        -1,      -1,        SEND,       -1,  IDLE,
       /* SEND   */    ENT_SEND,        -1,      -1,          -1,       -1,  IDLE,
     };
     // clang-format on
     Machine::begin(state_table, ELSE);
 
-    // The address can be changed making the option of connecting multiple devices
-    ads.getAddr_ADS1115(ADS1115_DEFAULT_ADDRESS);   // 0x48, 1001 000 (ADDR = GND)
-    // ads.getAddr_ADS1115(ADS1115_VDD_ADDRESS);    // 0x49, 1001 001 (ADDR = VDD)
-    // ads.getAddr_ADS1115(ADS1115_SDA_ADDRESS);    // 0x4A, 1001 010 (ADDR = SDA)
-    // ads.getAddr_ADS1115(ADS1115_SCL_ADDRESS);    // 0x4B, 1001 011 (ADDR = SCL)
-
-    // The ADC gain (PGA), Device operating mode, Data rate
-    // can be changed via the following functions
-
-    ads.setGain(GAIN_TWO);          // 2x gain   +/- 2.048V  1 bit = 0.0625mV (default)
-    //ads.setGain(GAIN_TWOTHIRDS);  // 2/3x gain +/- 6.144V  1 bit = 0.1875mV
-    // ads.setGain(GAIN_ONE);       // 1x gain   +/- 4.096V  1 bit = 0.125mV
-    // ads.setGain(GAIN_FOUR);      // 4x gain   +/- 1.024V  1 bit = 0.03125mV
-    // ads.setGain(GAIN_EIGHT);     // 8x gain   +/- 0.512V  1 bit = 0.015625mV
-    // ads.setGain(GAIN_SIXTEEN);   // 16x gain  +/- 0.256V  1 bit = 0.0078125mV
-
-    ads.setMode(MODE_CONTIN);       // Continuous conversion mode
-    // ads.setMode(MODE_SINGLE);    // Power-down single-shot mode (default)
-
-    // ads.setRate(RATE_128);          // 128SPS (default)
-    // ads.setRate(RATE_8);         // 8SPS
-    // ads.setRate(RATE_16);        // 16SPS
-    ads.setRate(RATE_32);        // 32SPS
-    // ads.setRate(RATE_64);        // 64SPS
-    // ads.setRate(RATE_250);       // 250SPS
-    // ads.setRate(RATE_475);       // 475SPS
-    // ads.setRate(RATE_860);       // 860SPS
-
-    ads.setOSMode(OSMODE_SINGLE);   // Set to start a single-conversion
-
-    ads.begin();
-
+    // Address, operating mode and data rate are fixed
+    // by the adc typedef in Atm_volume_sensor.hpp
+    this->channel = channel;
+    if ( !scan_owner ) {
+      twi.begin( 400000 );        // ADS1115 supports fast mode
+      scan_owner = this;
+      scan_next = this;
+    } else {
+      scan_next = scan_owner->scan_next;
+      scan_owner->scan_next = this;
+    }
+    scan_size++;
+    calibrate( volume_calibration_default );  // Continuous conversions on AIN<channel>
+
+    this->samplerate = samplerate;
     timer.set(samplerate);
 
+    // Every sensor samples less often now
+    Atm_volume_sensor* s = this;
+    do {
+      s->retime();
+      s = s->scan_next;
+    } while ( s != this );
+
     return *this;
   };
 
@@ -51,9 +48,12 @@ Atm_volume_sensor& Atm_volume_sensor::begin(int samplerate /* = 50 */) {
   int Atm_volume_sensor::event( int id ) {
   switch ( id ) {
     case EVT_TIMER:
-      return timer.expired( this );
+      if ( scan_owner != this ) {
+        return 0;
+      }
+      return sample_clock ? sample_clock->take() : timer.expired( this );
     case EVT_TRIGGER:
-      return v_previous != v_sample;
+      return conversion.due();
   }
   return 0;
 }
@@ -61,26 +61,15 @@ Atm_volume_sensor& Atm_volume_sensor::begin(int samplerate /* = 50 */) {
 void Atm_volume_sensor::action( int id ) {
   switch ( id ) {
     case ENT_SAMPLE:
-      v_previous = v_sample;
-      v_sample = sample();
+      request();
       return;
     case ENT_SEND:
-      v_sample = sample();
-      onchange.push( v_sample, v_sample > v_previous );
+      onchange.push( conversion.volume(), conversion.volume() > conversion.published() );
+      conversion.sent();
       return;
   }
 }
 
-Atm_volume_sensor& Atm_volume_sensor::range( int toLow, int toHigh ) {
-  this->toLow = toLow;
-  this->toHigh = toHigh;
-  return *this;
-}
-
-Atm_volume_sensor& Atm_volume_sensor::set( int value ) {  // Dummy method
-  return *this;
-}
-
 Atm_volume_sensor& Atm_volume_sensor::onChange( Machine& machine, int event /* = 0 */ ) {
   this->onchange.set( &machine, event );
   return *this;
@@ -91,85 +80,170 @@ Atm_volume_sensor& Atm_volume_sensor::onChange( atm_cb_push_t callback, int idx
   return *this;
 }
 
-int Atm_volume_sensor::read_sample() {
-  byte error;
-  int8_t address;
-
-  /*
-  float pressure = map(voltage*100, 100, 500, 0, 3500);
-  float water_height = pressure / 10 / 9.80665; // column heigh
-  float volume = water_height * PI * (60*60); // H * PI * r^2
-  */
-
-  address = ads.ads_i2cAddress;
-  // The i2c_scanner uses the return value of
-  // the Write.endTransmisstion to see if
-  // a device did acknowledge to the address.
-  Wire.beginTransmission(address);
-  error = Wire.endTransmission();
-  if (error == 0)
-  {
-      int16_t adc0;
-
-      //Serial.println("Getting Single-Ended Readings from AIN0..3");
-      //Serial.println(" ");
-      adc0 = ads.Measure_SingleEnded(0);
-      //Serial.print("Digital Value of Analog Input at Channel 1: ");
-      //Serial.println(adc0);
-      // float mACurrent = adc0 * 0.000628;
-      //Serial.print("Current Loop Input at Channel 1: ");
-      //Serial.println(mACurrent, 3);
-
-      // 6369 : 4mA
-      // 6760 : atmo
-      const float tank_radius = 4.5; // dm ... 93cm diam
-      // const int ma_at_cylinder_bottom = 8140; // = 32 liters are contained in bottom part, not linear
-      const int volume_offset = 810; // Account for non linear first 32 liters.
-
-      double mv = adc0 * 0.0625;
-
-      long int pascal = map(mv, 428, 2048, 0, 35000); // Map 428-2048mV to 0-35kpa
-      double water_height = pascal / 9.80665; // column heigh in mm
-      int volume = round((water_height * PI * powf(tank_radius, 2)) / 10.0) - volume_offset; // H * PI * r^2 ; in cl
-
-      return volume;
+// PGA gains, in the order of the ranges of VolumeConversion.cpp
+static const adsGain_t pga_gains[PGA_RANGES] = {
+  GAIN_TWOTHIRDS, GAIN_ONE, GAIN_TWO, GAIN_FOUR, GAIN_EIGHT, GAIN_SIXTEEN,
+};
+
+// New calibration, also sets the PGA gain and restarts conversions.
+// Invalid calibrations are ignored.
+Atm_volume_sensor& Atm_volume_sensor::calibrate( const volume_calibration_t& c ) {
+  if ( conversion.calibrate( c ) ) {
+    select();
   }
-  else
-  {
-      //Serial.println("ADS1115 Disconnected!");
-      return 0;
+  return *this;
+}
+
+// See VolumeConversion::reference(). AIN3 cannot reference itself.
+bool Atm_volume_sensor::reference( void ) {
+  if ( channel >= 3 || !conversion.reference() ) {
+    return false;
   }
+  select();
+  return true;
 }
 
-int Atm_volume_sensor::avg() {
-  uint16_t v = read_sample();
-  avg_buf_total = avg_buf_total + v - avg_buf[avg_buf_head];
-  avg_buf[avg_buf_head] = v;
-  if ( avg_buf_head + 1 >= avg_buf_size ) {
-    avg_buf_head = 0;
+// Restarts conversions on the range and input of the conversion, the
+// conversions in flight are dropped. Only the scan owner writes the
+// config, the others wait for pass().
+void Atm_volume_sensor::select( void ) {
+  conversion.settle();
+  if ( scan_owner != this ) {
+    return;
+  }
+  write_config();
+}
+
+// Queues the config of the range and the input. With the TWI pool full
+// the write stays pending and request() retries it before reading, so
+// no code is scaled with the LSB of a gain the ADC does not have.
+void Atm_volume_sensor::write_config( void ) {
+  adsGain_t gain = pga_gains[conversion.range()];
+  if ( conversion.referencing() ) {
+    config_pending = !adc::queueDifferential( channel * 10 + 3, gain );
   } else {
-    avg_buf_head++;
+    config_pending = !adc::queueSingleEnded( channel, gain );
+  }
+}
+
+// Hands the ADC to the next sensor of the scan
+void Atm_volume_sensor::pass( void ) {
+  if ( scan_next == this ) {
+    return;
   }
-  return avg_buf_total / avg_buf_size;
+  scan_owner = scan_next;
+  scan_owner->select();
 }
 
-int Atm_volume_sensor::sample() {
-  int v = avg_buf_size > 0 ? avg() : read_sample();
-  return v;
+// Time between two output samples, in ms, counting the other sensors
+// of the scan and the conversions dropped when switching to them
+uint16_t Atm_volume_sensor::sample_period( void ) {
+  uint16_t ticks = (uint16_t)1 << conversion.shift();
+  if ( scan_size > 1 ) {
+    ticks += PGA_SETTLE;
+  }
+  return timer.value * ticks * scan_size;
 }
 
+void Atm_volume_sensor::retime( void ) {
+  conversion.period( sample_period() );
+}
+
+// Queues the read of the latest conversion and returns, take() gets
+// the result from twi.poll(). A read still queued from the previous
+// tick means the bus is stuck: the tick is skipped until TwiQueue
+// times the read out. So is a tick whose config write still does not
+// fit in the pool.
+void Atm_volume_sensor::request() {
+  if ( read_pending ) {
+    return;
+  }
+  if ( config_pending ) {
+    write_config();
+    if ( config_pending ) {
+      return;
+    }
+  }
+  read_pending = adc::queueRead( on_read, this );
+  if ( !read_pending ) {
+    take( false, 0 );
+  }
+}
+
+void Atm_volume_sensor::on_read( const twi_transaction_t& t, void* context ) {
+  Atm_volume_sensor* sensor = (Atm_volume_sensor*)context;
+  sensor->read_pending = false;
+  sensor->take( t.status == TWI_DONE, adc::result( t ) );
+}
+
+// One conversion per tick, see VolumeConversion::take(). The config
+// is written before the ADC is handed on.
+void Atm_volume_sensor::take( bool ok, int16_t code ) {
+  int8_t pumping = pump_in ? pump_in->state() - pump_out->state() : 0;
+  uint8_t flags = conversion.take( ok, code, millis(), pumping );
+  if ( flags & TAKE_CONFIG ) {
+    select();
+  }
+  if ( flags & TAKE_PASS ) {
+    pass();
+  }
+}
+
+// Latest output sample, acquisition only happens on timer ticks
 int Atm_volume_sensor::state( void ) {
-  return sample();
+  return conversion.volume();
 }
 
-Atm_volume_sensor& Atm_volume_sensor::average( uint16_t* v, uint16_t size ) {
-  avg_buf = v;
-  avg_buf_size = size / sizeof( uint16_t );
-  avg_buf_head = 0;
-  avg_buf_total = 0;
-  for ( uint16_t i = 0; i < avg_buf_size; i++ ) {
-    avg_buf[i] = read_sample();
-    avg_buf_total += avg_buf[i];
+// Changes of at most v cl from the last published value are not pushed
+Atm_volume_sensor& Atm_volume_sensor::threshold( int v ) {
+  conversion.threshold( v );
+  return *this;
+}
+
+Atm_volume_sensor& Atm_volume_sensor::oversample( uint8_t shift ) {
+  conversion.oversample( shift );
+  // One tick per fresh conversion
+  timer.set( shift > 0 ? adc::conversion_delay : samplerate );
+  if ( sample_clock ) {
+    sample_clock->begin( timer.value * 1000UL );
   }
+  conversion.period( sample_period(), true );
+  return *this;
+}
+
+// Keeps the last output samples and their statistics in w
+Atm_volume_sensor& Atm_volume_sensor::window( SampleWindow& w ) {
+  conversion.window( &w.begin() );
+  return *this;
+}
+
+// Feeds the measured samples to d, which times the pump edges
+Atm_volume_sensor& Atm_volume_sensor::deadtime( DeadTime& d ) {
+  conversion.deadtime( &d );
+  return *this;
+}
+
+// Publishes the estimator's volume instead of the measured one. The
+// in / out machines (state 0 or 1) tell which pump is running.
+Atm_volume_sensor& Atm_volume_sensor::estimate( VolumeEstimator& e, Machine& in, Machine& out ) {
+  pump_in = &in;
+  pump_out = &out;
+  conversion.period( sample_period() );
+  conversion.estimate( &e );
+  return *this;
+}
+
+// Starts the estimator from a saved state instead of the first
+// measurement, after estimate()
+Atm_volume_sensor& Atm_volume_sensor::warm( const estimator_state_t& s ) {
+  conversion.warm( s );
+  return *this;
+}
+
+// Paces acquisition from the hardware timer instead of millis(),
+// at the current sample period
+Atm_volume_sensor& Atm_volume_sensor::clock( SampleClock& clock ) {
+  sample_clock = &clock;
+  sample_clock->begin( timer.value * 1000UL );
   return *this;
 }
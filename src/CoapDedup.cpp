@@ -0,0 +1,40 @@
+#include "CoapDedup.hpp"
+
+CoapDedup& CoapDedup::begin( uint32_t lifetime /* = COAP_EXCHANGE_LIFETIME */ ) {
+  this->lifetime = lifetime;
+  memset( entries, 0, sizeof( entries ) );
+  return *this;
+}
+
+bool CoapDedup::lookup( IPAddress ip, uint16_t port, uint16_t messageid, uint8_t& code ) {
+  uint32_t now = millis();
+  for ( uint8_t i = 0; i < COAP_DEDUP_SIZE; i++ ) {
+    const entry_t& e = entries[i];
+    if ( e.messageid == messageid && e.port == port && e.ip == (uint32_t)ip && !expired( e, now ) ) {
+      code = e.code;
+      return true;
+    }
+  }
+  return false;
+}
+
+// Takes an expired slot if there is one, otherwise evicts the oldest
+void CoapDedup::store( IPAddress ip, uint16_t port, uint16_t messageid, uint8_t code ) {
+  uint32_t now = millis();
+  uint8_t victim = 0;
+  for ( uint8_t i = 0; i < COAP_DEDUP_SIZE; i++ ) {
+    if ( expired( entries[i], now ) ) {
+      victim = i;
+      break;
+    }
+    if ( now - entries[i].stored > now - entries[victim].stored ) {
+      victim = i;
+    }
+  }
+  entry_t& e = entries[victim];
+  e.ip = (uint32_t)ip;
+  e.port = port;
+  e.messageid = messageid;
+  e.stored = now;
+  e.code = code;
+}
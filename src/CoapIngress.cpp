@@ -0,0 +1,273 @@
+#include "CoapIngress.hpp"
+#include "CoapResponse.hpp"
+
+// Datagrams are read into current, which Coap is done with by then:
+// poll() runs before Coap::loop() and parsePacket() refills it.
+void CoapIngress::poll( void ) {
+  int length;
+  while ( ( length = udp.parsePacket() ) > 0 ) {
+    if ( length > COAP_INGRESS_MTU || length < COAP_HEADER_SIZE ) {
+      udp.flush();
+      counters.dropped++;
+      continue;
+    }
+
+    current.ip = udp.remoteIP();
+    current.port = udp.remotePort();
+    current.length = udp.read( current.data, length );
+    pos = current.length;
+
+    if ( depth == COAP_INGRESS_SLOTS && !make_room( current ) ) {
+      continue;
+    }
+    queue[depth++] = current;
+    counters.queued++;
+    if ( depth > counters.peak ) {
+      counters.peak = depth;
+    }
+  }
+}
+
+// Frees a slot by dropping the oldest non-confirmable request. If all
+// are confirmable the incoming one is refused instead: answered 5.03
+// when it is confirmable itself, silently dropped otherwise.
+bool CoapIngress::make_room( const datagram_t& incoming ) {
+  for ( uint8_t i = 0; i < depth; i++ ) {
+    if ( type( queue[i] ) == COAP_NONCON ) {
+      remove( i );
+      counters.dropped++;
+      return true;
+    }
+  }
+  if ( type( incoming ) == COAP_CON ) {
+    reject( incoming );
+    counters.rejected++;
+  } else {
+    counters.dropped++;
+  }
+  return false;
+}
+
+void CoapIngress::remove( uint8_t i ) {
+  depth--;
+  for ( ; i < depth; i++ ) {
+    queue[i] = queue[i + 1];
+  }
+}
+
+// 5.03 Service Unavailable, the client may retry after Max-Age seconds
+void CoapIngress::reject( const datagram_t& d ) {
+  CoapPacket request;
+  request.type = COAP_CON;
+  request.tokenlen = d.data[0] & 0x0F;
+  if ( request.tokenlen > 8 || COAP_HEADER_SIZE + request.tokenlen > d.length ) {
+    return;
+  }
+  request.token = (uint8_t*)d.data + COAP_HEADER_SIZE;
+  request.messageid = ( d.data[2] << 8 ) | d.data[3];
+  CoapResponse( udp )
+    .begin( request, d.ip, d.port, COAP_SERVICE_UNAVALIABLE )
+    .option( COAP_MAX_AGE, (uint32_t)COAP_INGRESS_RETRY_AFTER )
+    .send();
+}
+
+// Hands the oldest queued datagram to Coap, within the serve() allowance.
+// Requests for our own resources are served on the way.
+int CoapIngress::parsePacket( void ) {
+  while ( depth > 0 && allowance > 0 ) {
+    allowance--;
+    current = queue[0];
+    remove( 0 );
+    route( current );
+    pos = 0;
+    counters.served++;
+    if ( !dispatch( current ) ) {
+      return current.length;
+    }
+  }
+  current.length = 0;
+  pos = 0;
+  return 0;
+}
+
+// False when the table is full
+bool CoapIngress::server( callback handler, const char* path ) {
+  if ( handler_count == COAP_INGRESS_HANDLERS ) {
+    return false;
+  }
+  handlers[handler_count].handler = handler;
+  handlers[handler_count].path = path;
+  handler_count++;
+  return true;
+}
+
+// Option header at p: number delta and value length, with their
+// extended bytes. Returns the header size, 0 at the payload marker or
+// on a malformed option.
+static uint8_t option_header( const uint8_t* p, const uint8_t* end, uint16_t& delta, uint16_t& length ) {
+  const uint8_t* q = p + 1;
+  uint16_t fields[2] = { (uint16_t)( *p >> 4 ), (uint16_t)( *p & 0x0F ) };
+  if ( *p == 0xFF ) {
+    return 0;
+  }
+  for ( uint8_t i = 0; i < 2; i++ ) {
+    if ( fields[i] == 13 ) {
+      if ( q >= end ) return 0;
+      fields[i] = 13 + *q++;
+    } else if ( fields[i] == 14 ) {
+      if ( q + 1 >= end ) return 0;
+      fields[i] = 269 + ( q[0] << 8 ) + q[1];
+      q += 2;
+    } else if ( fields[i] == 15 ) {
+      return 0;
+    }
+  }
+  delta = fields[0];
+  length = fields[1];
+  return q - p;
+}
+
+// Strips the leading collection_name/<n> Uri-Path options and keeps n.
+// The option after them gets its delta back from the option before.
+void CoapIngress::route( datagram_t& d ) {
+  current_index = 0;
+  if ( !collection_name ) {
+    return;
+  }
+  uint8_t* end = d.data + d.length;
+  uint8_t* p = d.data + COAP_HEADER_SIZE + ( d.data[0] & 0x0F );
+  uint16_t number = 0, delta, length;
+  uint8_t* first = NULL;  // collection segment
+  uint16_t before = 0;    // option number preceding it
+  uint8_t index = 0;
+  bool found = false;
+  while ( p < end ) {
+    uint8_t h = option_header( p, end, delta, length );
+    if ( h == 0 || p + h + length > end ) {
+      return;
+    }
+    uint8_t* value = p + h;
+    if ( number + delta != COAP_URI_PATH ) {
+      if ( first ) return;
+      number += delta;
+      p = value + length;
+      continue;
+    }
+    if ( !first ) {
+      if ( length != strlen( collection_name ) || memcmp( value, collection_name, length ) ) {
+        return;
+      }
+      first = p;
+      before = number;
+    } else {
+      // The index, 1 to 3 digits
+      if ( length == 0 || length > 3 ) return;
+      uint16_t n = 0;
+      for ( uint8_t i = 0; i < length; i++ ) {
+        if ( value[i] < '0' || value[i] > '9' ) return;
+        n = n * 10 + value[i] - '0';
+      }
+      if ( n > 0xFF ) return;
+      index = n;
+      found = true;
+      p = value + length;
+      break;
+    }
+    number += delta;
+    p = value + length;
+  }
+  if ( !found ) {
+    return;
+  }
+  // Next option, a Uri-Path segment (delta 0) in practice. Its delta
+  // must stay in the header nibble to be rewritten in place.
+  if ( p < end && *p != 0xFF ) {
+    uint8_t h = option_header( p, end, delta, length );
+    if ( h == 0 || ( *p >> 4 ) >= 13 ) return;
+    uint16_t rebased = COAP_URI_PATH + delta - before;
+    if ( rebased >= 13 ) return;
+    *p = ( rebased << 4 ) | ( *p & 0x0F );
+  }
+  memmove( first, p, end - p );
+  d.length -= p - first;
+  current_index = index;
+}
+
+// Uri-Path segments joined by '/' equal path
+static bool path_matches( const CoapPacket& packet, const char* path ) {
+  for ( uint8_t i = 0; i < packet.optionnum; i++ ) {
+    const CoapOption& o = packet.options[i];
+    if ( o.number != COAP_URI_PATH ) {
+      continue;
+    }
+    if ( o.length > strlen( path ) || memcmp( path, o.buffer, o.length ) ) {
+      return false;
+    }
+    path += o.length;
+    if ( *path == '/' ) {
+      path++;
+    } else if ( *path ) {
+      return false;
+    }
+  }
+  return *path == 0;
+}
+
+// Parses d the way Coap does and calls the handler registered for its
+// path. False if there is none or d does not parse, Coap answers then.
+bool CoapIngress::dispatch( datagram_t& d ) {
+  if ( handler_count == 0 ) {
+    return false;
+  }
+  CoapPacket packet;
+  packet.type = type( d );
+  packet.code = d.data[1];
+  packet.messageid = ( d.data[2] << 8 ) | d.data[3];
+  packet.tokenlen = d.data[0] & 0x0F;
+  if ( packet.tokenlen > 8 || COAP_HEADER_SIZE + packet.tokenlen > d.length ) {
+    return false;
+  }
+  packet.token = d.data + COAP_HEADER_SIZE;
+  packet.payload = NULL;
+  packet.payloadlen = 0;
+  packet.optionnum = 0;
+
+  uint8_t* end = d.data + d.length;
+  uint8_t* p = packet.token + packet.tokenlen;
+  uint16_t number = 0, delta, length;
+  while ( p < end ) {
+    if ( *p == COAP_PAYLOAD_MARKER ) {
+      packet.payload = p + 1;
+      packet.payloadlen = end - p - 1;
+      break;
+    }
+    uint8_t h = option_header( p, end, delta, length );
+    if ( h == 0 || p + h + length > end || packet.optionnum == MAX_OPTION_NUM ) {
+      return false;
+    }
+    number += delta;
+    CoapOption& o = packet.options[packet.optionnum++];
+    o.number = number;
+    o.length = length;
+    o.buffer = p + h;
+    p += h + length;
+  }
+
+  for ( uint8_t i = 0; i < handler_count; i++ ) {
+    if ( path_matches( packet, handlers[i].path ) ) {
+      handlers[i].handler( packet, d.ip, d.port );
+      return true;
+    }
+  }
+  return false;
+}
+
+int CoapIngress::read( unsigned char* buffer, size_t len ) {
+  size_t n = current.length - pos;
+  if ( len < n ) {
+    n = len;
+  }
+  memcpy( buffer, current.data + pos, n );
+  pos += n;
+  return n;
+}
@@ -0,0 +1,77 @@
+#include "CoapResponse.hpp"
+
+CoapResponse& CoapResponse::begin( CoapPacket& request, IPAddress ip, int port, uint8_t code ) {
+  // Piggybacked on the ACK for confirmable requests
+  uint8_t type = request.type == COAP_CON ? COAP_ACK : COAP_NONCON;
+  udp.beginPacket( ip, port );
+  udp.write( (uint8_t)( 0x40 | ( type << 4 ) | ( request.tokenlen & 0x0F ) ) );
+  udp.write( code );
+  udp.write( (uint8_t)( request.messageid >> 8 ) );
+  udp.write( (uint8_t)( request.messageid & 0xFF ) );
+  udp.write( request.token, request.tokenlen );
+  last_option = 0;
+  return *this;
+}
+
+CoapResponse& CoapResponse::begin( IPAddress ip, int port, uint8_t type, uint8_t code, uint16_t messageid ) {
+  udp.beginPacket( ip, port );
+  udp.write( (uint8_t)( 0x40 | ( type << 4 ) ) );
+  udp.write( code );
+  udp.write( (uint8_t)( messageid >> 8 ) );
+  udp.write( (uint8_t)( messageid & 0xFF ) );
+  last_option = 0;
+  return *this;
+}
+
+// Option header with extended delta / length bytes, RFC 7252 3.1
+void CoapResponse::header( uint16_t delta, uint16_t length ) {
+  uint8_t d = delta < 13 ? delta : ( delta < 269 ? 13 : 14 );
+  uint8_t l = length < 13 ? length : ( length < 269 ? 13 : 14 );
+  udp.write( (uint8_t)( ( d << 4 ) | l ) );
+  if ( d == 13 ) udp.write( (uint8_t)( delta - 13 ) );
+  if ( d == 14 ) {
+    udp.write( (uint8_t)( ( delta - 269 ) >> 8 ) );
+    udp.write( (uint8_t)( ( delta - 269 ) & 0xFF ) );
+  }
+  if ( l == 13 ) udp.write( (uint8_t)( length - 13 ) );
+  if ( l == 14 ) {
+    udp.write( (uint8_t)( ( length - 269 ) >> 8 ) );
+    udp.write( (uint8_t)( ( length - 269 ) & 0xFF ) );
+  }
+}
+
+CoapResponse& CoapResponse::option( uint8_t number, const uint8_t* value, uint8_t length ) {
+  header( number - last_option, length );
+  udp.write( value, length );
+  last_option = number;
+  return *this;
+}
+
+// uint options use the shortest big-endian encoding, 0 has no bytes
+CoapResponse& CoapResponse::option( uint8_t number, uint32_t value ) {
+  uint8_t bytes[4];
+  uint8_t length = 0;
+  for ( int8_t shift = 24; shift >= 0; shift -= 8 ) {
+    uint8_t b = value >> shift;
+    if ( b || length ) bytes[length++] = b;
+  }
+  return option( number, bytes, length );
+}
+
+CoapResponse& CoapResponse::payload( const uint8_t* data, uint16_t length ) {
+  if ( length > 0 ) {
+    udp.write( (uint8_t)COAP_PAYLOAD_MARKER );
+    udp.write( data, length );
+  }
+  return *this;
+}
+
+// Payload marker, the caller writes the payload and calls send()
+Print& CoapResponse::body( void ) {
+  udp.write( (uint8_t)COAP_PAYLOAD_MARKER );
+  return udp;
+}
+
+int CoapResponse::send( void ) {
+  return udp.endPacket();
+}
@@ -0,0 +1,135 @@
+#include "DeadTime.hpp"
+
+DeadTime& DeadTime::begin( int16_t drift, int16_t threshold ) {
+  this->drift = drift;
+  this->threshold = threshold;
+  last_pumping = 0;
+  active = false;
+  for ( uint8_t i = 0; i < DEADTIME_EDGES; i++ ) {
+    history_head[i] = measured[i] = missed[i] = 0;
+  }
+  return *this;
+}
+
+// pumping: > 0 filling, < 0 transferring, 0 idle, as commanded at now.
+// volume and flow are the estimate just before the edge.
+void DeadTime::edge( int8_t pumping, uint32_t now, int16_t volume, int16_t flow ) {
+  if ( pumping == last_pumping ) {
+    return;
+  }
+  if ( active ) {
+    miss();
+  }
+  if ( pumping > 0 ) {
+    slot = DEADTIME_IN_ON;
+  } else if ( pumping < 0 ) {
+    slot = DEADTIME_OUT_ON;
+  } else {
+    slot = last_pumping > 0 ? DEADTIME_IN_OFF : DEADTIME_OUT_OFF;
+  }
+  direction = pumping > last_pumping ? 1 : -1;
+  last_pumping = pumping;
+
+  edge_time = now;
+  base_volume = volume;
+  base_flow = flow;
+  cusum = 0;
+  restart_fit( 0 );
+  active = true;
+}
+
+// measured: cl before any filtering, t: ms the sample stands for
+void DeadTime::sample( int16_t measured, uint32_t t ) {
+  if ( !active ) {
+    return;
+  }
+  int32_t elapsed = t - edge_time;
+  if ( elapsed < 0 ) {
+    return;  // taken before the edge
+  }
+  if ( elapsed > DEADTIME_TIMEOUT ) {
+    miss();
+    return;
+  }
+
+  // Distance from the trend at the edge, positive the way the edge
+  // should move the volume
+  int32_t r = direction * ( measured - base_volume - (int32_t)base_flow * elapsed / 1000 );
+  cusum += r - drift;
+  if ( cusum <= 0 ) {
+    cusum = 0;
+    restart_fit( elapsed );
+  }
+  float t_fit = elapsed - fit_origin;
+  fit_n++;
+  fit_t += t_fit;
+  fit_r += r;
+  fit_tt += t_fit * t_fit;
+  fit_tr += t_fit * r;
+  if ( cusum < threshold ) {
+    return;
+  }
+
+  // The volume answered: date it where the line through the samples
+  // since the CUSUM left 0 crosses the trend, at fit_origin if the
+  // line is flat
+  int32_t onset = fit_origin;
+  float den = fit_n * fit_tt - fit_t * fit_t;
+  if ( fit_n >= 3 && den > 0 ) {
+    float slope = ( fit_n * fit_tr - fit_t * fit_r ) / den;
+    if ( slope > 0 ) {
+      onset += ( slope * fit_t - fit_r ) / ( slope * fit_n );
+    }
+  }
+  if ( onset < 0 ) onset = 0;
+  if ( onset > elapsed ) onset = elapsed;
+  store( onset );
+  active = false;
+}
+
+void DeadTime::restart_fit( int32_t origin ) {
+  fit_origin = origin;
+  fit_n = 0;
+  fit_t = fit_r = fit_tt = fit_tr = 0;
+}
+
+// No answer in time, or the next edge came first
+void DeadTime::miss( void ) {
+  if ( missed[slot] < 0xFF ) {
+    missed[slot]++;
+  }
+  active = false;
+}
+
+void DeadTime::store( uint16_t ms ) {
+  history[slot][history_head[slot]] = ms;
+  history_head[slot] = ( history_head[slot] + 1 ) % DEADTIME_HISTORY;
+  if ( measured[slot] < 0xFF ) {
+    measured[slot]++;
+  }
+}
+
+// Median of the last measurements of an edge in ms, 0 if there is none
+uint16_t DeadTime::median( uint8_t edge ) {
+  uint8_t n = measured[edge] < DEADTIME_HISTORY ? measured[edge] : DEADTIME_HISTORY;
+  if ( n == 0 ) {
+    return 0;
+  }
+  uint16_t sorted[DEADTIME_HISTORY];
+  for ( uint8_t i = 0; i < n; i++ ) {
+    uint16_t v = history[edge][i];
+    uint8_t j = i;
+    for ( ; j > 0 && sorted[j - 1] > v; j-- ) {
+      sorted[j] = sorted[j - 1];
+    }
+    sorted[j] = v;
+  }
+  return sorted[n / 2];
+}
+
+void DeadTime::report( uint8_t edge, deadtime_report_t& r ) {
+  r.median_ms = median( edge );
+  r.last_ms = measured[edge] ? history[edge][( history_head[edge] + DEADTIME_HISTORY - 1 ) % DEADTIME_HISTORY] : 0;
+  r.measured = measured[edge];
+  r.missed = missed[edge];
+}
@@ -0,0 +1,69 @@
+#include "IdleSleep.hpp"
+
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+
+IdleSleep idle;
+
+IdleSleep& IdleSleep::begin( bool ( *ready )( void ) ) {
+  this->ready = ready;
+  held = false;
+  idle_report_t unused;
+  report( unused );
+  // analogRead() is not used: the ADC and the analog comparator would
+  // draw current through every sleep
+  ADCSRA = 0;
+  ACSR = _BV( ACD );
+  PRR |= _BV( PRADC );
+  set_sleep_mode( SLEEP_MODE_IDLE );
+  return *this;
+}
+
+// Enables the pin change interrupt of an Arduino pin as a wake source.
+// The vectors are in PinEvents.cpp.
+IdleSleep& IdleSleep::wake_on( uint8_t pin ) {
+  *digitalPinToPCMSK( pin ) |= _BV( digitalPinToPCMSKbit( pin ) );
+  *digitalPinToPCICR( pin ) |= _BV( digitalPinToPCICRbit( pin ) );
+  return *this;
+}
+
+void IdleSleep::sleep( void ) {
+  if ( held ) {
+    held = false;
+    return;
+  }
+  uint32_t since = micros();
+  cli();
+  if ( ready && ready() ) {
+    sei();
+    return;
+  }
+  sleep_enable();
+  // The instruction after sei is executed before any interrupt, so one
+  // arriving from here on wakes the sleep instead of preceding it
+  sei();
+  sleep_cpu();
+  sleep_disable();
+  uint32_t slept = micros() - since;
+  asleep_us += slept % 1000;
+  asleep_ms += slept / 1000 + asleep_us / 1000;
+  asleep_us %= 1000;
+  sleeps++;
+  if ( slept > longest_us ) {
+    longest_us = slept > 0xFFFF ? 0xFFFF : slept;
+  }
+}
+
+// Fills r and starts a new window
+void IdleSleep::report( idle_report_t& r ) {
+  uint32_t now = millis();
+  r.window_ms = now - window_start;
+  r.duty_permille = r.window_ms > asleep_ms ? 1000 - (uint64_t)asleep_ms * 1000 / r.window_ms : 0;
+  r.sleeps = sleeps;
+  r.longest_us = longest_us;
+  window_start = now;
+  asleep_ms = 0;
+  asleep_us = 0;
+  sleeps = 0;
+  longest_us = 0;
+}
@@ -0,0 +1,108 @@
+#include "PinEvents.hpp"
+
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+
+PinEvents pin_events;
+
+// Keeps the compiler from moving ring accesses across head / tail updates
+#define COMPILER_BARRIER() __asm__ __volatile__( "" ::: "memory" )
+
+ISR( PCINT0_vect ) {
+  pin_events.capture();
+}
+ISR( PCINT1_vect, ISR_ALIASOF( PCINT0_vect ) );
+ISR( PCINT2_vect, ISR_ALIASOF( PCINT0_vect ) );
+
+// Adds pin to the watched ones and enables its pin change interrupt.
+// Call from setup(), before the first edge matters.
+PinEvents& PinEvents::watch( uint8_t pin, uint8_t mode ) {
+  if ( count == PIN_EVENTS_PINS ) {
+    return *this;
+  }
+  pinMode( pin, mode );
+  uint8_t sreg = SREG;
+  cli();
+  in[count] = portInputRegister( digitalPinToPort( pin ) );
+  mask[count] = digitalPinToBitMask( pin );
+  count++;
+  last = levels();
+  *digitalPinToPCMSK( pin ) |= _BV( digitalPinToPCMSKbit( pin ) );
+  *digitalPinToPCICR( pin ) |= _BV( digitalPinToPCICRbit( pin ) );
+  SREG = sreg;
+  return *this;
+}
+
+uint8_t PinEvents::levels( void ) {
+  uint8_t pins = 0;
+  for ( uint8_t i = 0; i < count; i++ ) {
+    if ( *in[i] & mask[i] ) {
+      pins |= 1 << i;
+    }
+  }
+  return pins;
+}
+
+// From the interrupts. Changes of pins nobody watches are ignored, an
+// edge that finds the ring full is counted and lost.
+void PinEvents::capture( void ) {
+  uint8_t pins = levels();
+  if ( pins == last ) {
+    return;
+  }
+  last = pins;
+  uint8_t next = ( head + 1 ) & ( PIN_EVENTS_SIZE - 1 );
+  if ( next == tail ) {
+    overflows++;
+    return;
+  }
+  ring[head].timestamp = millis();
+  ring[head].pins = pins;
+  COMPILER_BARRIER();
+  head = next;
+}
+
+// Oldest edge into e, false if there is none
+bool PinEvents::pop( pin_event_t& e ) {
+  if ( tail == head ) {
+    return false;
+  }
+  COMPILER_BARRIER();
+  e = ring[tail];
+  COMPILER_BARRIER();
+  tail = ( tail + 1 ) & ( PIN_EVENTS_SIZE - 1 );
+  return true;
+}
+
+// Valid transitions by previous and current (a, b) levels, the others
+// are bounce or a missed edge
+static const int8_t quadrature_steps[16] PROGMEM = { 0, -1, 1, 0, 1, 0, 0, -1, -1, 0, 0, 1, 0, 1, -1, 0 };
+
+int8_t Quadrature::update( bool a, bool b ) {
+  bits = ( ( bits << 2 ) | ( a << 1 ) | b ) & 0x0F;
+  count += (int8_t)pgm_read_byte( &quadrature_steps[bits] );
+  if ( count >= divider ) {
+    count = 0;
+    return 1;
+  }
+  if ( count <= -divider ) {
+    count = 0;
+    return -1;
+  }
+  return 0;
+}
+
+void Debounce::sample( bool level, uint16_t timestamp ) {
+  if ( level != raw ) {
+    raw = level;
+    changed_at = timestamp;
+  }
+}
+
+bool Debounce::update( uint16_t now ) {
+  if ( raw == stable || (uint16_t)( now - changed_at ) < ms ) {
+    return false;
+  }
+  stable = raw;
+  return true;
+}
@@ -0,0 +1,80 @@
+#include "SampleClock.hpp"
+
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+
+SampleClock sample_clock;
+
+ISR( TIMER1_COMPA_vect ) {
+  sample_clock.tick();
+}
+
+// Timer1 in CTC mode, 0.5us resolution up to 32ms, 4us up to 262ms
+SampleClock& SampleClock::begin( uint32_t period_us ) {
+  sample_clock_report_t unused;
+  report( unused );
+  pending = false;
+  ATOMIC_BLOCK( ATOMIC_RESTORESTATE ) {
+    TCCR1A = 0;
+    TCNT1 = 0;
+    if ( period_us <= 32768 ) {
+      OCR1A = period_us * ( F_CPU / 8000000UL ) - 1;
+      TCCR1B = _BV( WGM12 ) | _BV( CS11 );  // clk/8
+    } else {
+      OCR1A = period_us / ( 64000000UL / F_CPU ) - 1;
+      TCCR1B = _BV( WGM12 ) | _BV( CS11 ) | _BV( CS10 );  // clk/64
+    }
+    TIMSK1 = _BV( OCIE1A );
+  }
+  return *this;
+}
+
+void SampleClock::tick( void ) {
+  if ( pending ) {
+    missed++;
+  }
+  pending = true;
+  tick_at = micros();
+}
+
+// Consumes the pending tick, if any
+bool SampleClock::take( void ) {
+  uint32_t tick;
+  ATOMIC_BLOCK( ATOMIC_RESTORESTATE ) {
+    if ( !pending ) {
+      return false;
+    }
+    pending = false;
+    tick = tick_at;
+  }
+  uint32_t latency = micros() - tick;
+  if ( latency > max_latency ) {
+    max_latency = latency > 0xFFFF ? 0xFFFF : latency;
+  }
+  if ( ticks == 0 ) {
+    first_taken = tick;
+  } else {
+    uint32_t period = tick - taken_tick;
+    if ( period < min_period ) min_period = period;
+    if ( period > max_period ) max_period = period;
+  }
+  taken_tick = tick;
+  ticks++;
+  return true;
+}
+
+// Fills r and starts a new statistics window
+void SampleClock::report( sample_clock_report_t& r ) {
+  r.period_us = ticks > 1 ? ( taken_tick - first_taken ) / ( ticks - 1 ) : 0;
+  r.jitter_us = ticks > 1 ? max_period - min_period : 0;
+  r.latency_us = max_latency;
+  ATOMIC_BLOCK( ATOMIC_RESTORESTATE ) {
+    r.missed = missed;
+    missed = 0;
+  }
+  r.ticks = ticks;
+  ticks = 0;
+  min_period = 0xFFFFFFFF;
+  max_period = 0;
+  max_latency = 0;
+}
@@ -0,0 +1,77 @@
+#include "SampleWindow.hpp"
+
+SampleWindow& SampleWindow::begin( void ) {
+  head = n = 0;
+  pushed = 0;
+  w_mean = w_m2 = 0;
+  min_head = min_len = max_head = max_len = 0;
+  return *this;
+}
+
+void SampleWindow::push( uint32_t timestamp, int16_t code, int16_t volume ) {
+  uint8_t i = head;
+
+  // The slot about to be overwritten leaves the window
+  if ( n == SAMPLE_WINDOW_SIZE ) {
+    if ( min_len && min_q[min_head] == i ) {
+      min_head = wrap( min_head + 1 );
+      min_len--;
+    }
+    if ( max_len && max_q[max_head] == i ) {
+      max_head = wrap( max_head + 1 );
+      max_len--;
+    }
+    float old = ring[i].volume;
+    float next_mean = w_mean + ( volume - old ) / n;
+    w_m2 += ( volume - old ) * ( volume - next_mean + old - w_mean );
+    if ( w_m2 < 0 ) w_m2 = 0;
+    w_mean = next_mean;
+  } else {
+    n++;
+    float d = volume - w_mean;
+    w_mean += d / n;
+    w_m2 += d * ( volume - w_mean );
+  }
+
+  ring[i].timestamp = timestamp;
+  ring[i].code = code;
+  ring[i].volume = volume;
+
+  while ( min_len && ring[min_q[wrap( min_head + min_len - 1 )]].volume >= volume ) {
+    min_len--;
+  }
+  min_q[wrap( min_head + min_len++ )] = i;
+  while ( max_len && ring[max_q[wrap( max_head + max_len - 1 )]].volume <= volume ) {
+    max_len--;
+  }
+  max_q[wrap( max_head + max_len++ )] = i;
+
+  head = wrap( i + 1 );
+  pushed++;
+
+  // Sliding updates drift in float, start from exact sums once per lap
+  if ( head == 0 && n == SAMPLE_WINDOW_SIZE ) {
+    recompute();
+  }
+}
+
+void SampleWindow::recompute( void ) {
+  int32_t sum = 0;
+  for ( uint8_t i = 0; i < n; i++ ) {
+    sum += ring[i].volume;
+  }
+  w_mean = (float)sum / n;
+  w_m2 = 0;
+  for ( uint8_t i = 0; i < n; i++ ) {
+    float d = ring[i].volume - w_mean;
+    w_m2 += d * d;
+  }
+}
+
+const volume_sample_t& SampleWindow::at( uint8_t age ) {
+  return ring[wrap( head + SAMPLE_WINDOW_SIZE - 1 - age )];
+}
+
+uint32_t SampleWindow::span( void ) {
+  return n > 1 ? at( 0 ).timestamp - at( n - 1 ).timestamp : 0;
+}
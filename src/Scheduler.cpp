@@ -0,0 +1,84 @@
+#include "Scheduler.hpp"
+
+Scheduler& Scheduler::begin( uint16_t iteration_budget_us ) {
+  budget_us = iteration_budget_us;
+  n = 0;
+  loop_peak_us = 0;
+  iterations = 0;
+  deferred = false;
+  return *this;
+}
+
+// Returns the task id, used by task() and peak(), or NO_TASK when
+// SCHEDULER_MAX_TASKS are already added
+uint8_t Scheduler::add( task_fn_t run, const char* name, uint16_t budget_us, uint8_t priority ) {
+  if ( n == SCHEDULER_MAX_TASKS ) {
+    return NO_TASK;
+  }
+  uint8_t id = n++;
+  task_t& t = tasks[id];
+  memset( &t, 0, sizeof( t ) );
+  t.run = run;
+  t.name = name;
+  t.budget_us = budget_us;
+  t.priority = priority;
+
+  uint8_t i = id;
+  while ( i > 0 && tasks[order[i - 1]].priority > priority ) {
+    order[i] = order[i - 1];
+    i--;
+  }
+  order[i] = id;
+  return id;
+}
+
+void Scheduler::run( void ) {
+  uint32_t start = micros();
+  deferred = false;
+  for ( uint8_t i = 0; i < n; i++ ) {
+    task_t& t = tasks[order[i]];
+    uint32_t begun = micros();
+    if ( t.priority != TASK_CRITICAL && !t.skipped && begun - start + t.budget_us > budget_us ) {
+      t.skipped = true;
+      t.yields++;
+      deferred = true;
+      continue;
+    }
+    t.skipped = false;
+    t.run();
+    uint32_t took = micros() - begun;
+    if ( took > t.budget_us ) {
+      t.overruns++;
+    }
+    for ( uint8_t r = 0; r < SCHEDULER_PEAK_READERS; r++ ) {
+      if ( took > t.peak_us[r] ) {
+        t.peak_us[r] = took > 0xFFFF ? 0xFFFF : took;
+      }
+    }
+  }
+  uint32_t took = micros() - start;
+  if ( took > loop_peak_us ) {
+    loop_peak_us = took > 0xFFFF ? 0xFFFF : took;
+  }
+  iterations++;
+}
+
+// Longest iteration since the previous call, by default starting a new
+// measurement
+uint16_t Scheduler::loop_peak( bool reset ) {
+  uint16_t p = loop_peak_us;
+  if ( reset ) {
+    loop_peak_us = 0;
+  }
+  return p;
+}
+
+// Longest run of a task since the previous call by the same reader,
+// by default starting a new measurement for that reader only
+uint16_t Scheduler::peak( uint8_t id, uint8_t reader, bool reset ) {
+  uint16_t p = tasks[id].peak_us[reader];
+  if ( reset ) {
+    tasks[id].peak_us[reader] = 0;
+  }
+  return p;
+}
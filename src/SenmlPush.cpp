@@ -0,0 +1,140 @@
+#include "SenmlPush.hpp"
+
+SenmlPush& SenmlPush::begin( const char* base_name, uint16_t messageid ) {
+  this->base_name = base_name;
+  this->messageid = messageid;
+  port = 0;
+  interval_ms = 0;
+  head = count = sending = written = 0;
+  last_push = millis();
+  memset( &counters, 0, sizeof( counters ) );
+  return *this;
+}
+
+// Port 0 stops pushing and drops what was batched, a datagram being
+// written is abandoned
+SenmlPush& SenmlPush::collector( IPAddress ip, uint16_t port ) {
+  this->ip = ip;
+  this->port = port;
+  if ( port == 0 ) {
+    count = sending = 0;
+  }
+  return *this;
+}
+
+// 0 pushes full batches only
+SenmlPush& SenmlPush::interval( uint16_t seconds ) {
+  interval_ms = seconds * 1000UL;
+  return *this;
+}
+
+// Queues a sample, false if the batch is full and still being sent
+bool SenmlPush::record( const senml_sample_t& s ) {
+  if ( !enabled() ) {
+    return false;
+  }
+  if ( count == SENML_BATCH_SIZE ) {
+    counters.dropped++;
+    return false;
+  }
+  batch[( head + count ) % SENML_BATCH_SIZE] = s;
+  count++;
+  return true;
+}
+
+// Writes the next sample of the datagram in progress, or starts one
+// when the batch is full or the interval elapsed
+void SenmlPush::poll( void ) {
+  if ( sending > 0 ) {
+    write_sample( batch[head], written++ == 0 );
+    head = ( head + 1 ) % SENML_BATCH_SIZE;
+    count--;
+    if ( --sending > 0 ) {
+      return;
+    }
+    message.body().write( ']' );
+    if ( message.send() ) {
+      counters.batches++;
+    } else {
+      counters.errors++;
+    }
+    return;
+  }
+  if ( !enabled() || count == 0 ) {
+    return;
+  }
+  if ( count == SENML_BATCH_SIZE || ( interval_ms > 0 && millis() - last_push >= interval_ms ) ) {
+    start();
+  }
+}
+
+// CoAP header and options, samples follow in the next polls
+void SenmlPush::start( void ) {
+  static const char path[] = "senml";
+  last_push = sent_at = millis();
+  sending = count;
+  written = 0;
+  message.begin( ip, port, COAP_NONCON, COAP_POST, messageid++ )
+    .option( COAP_URI_PATH, (const uint8_t*)path, sizeof( path ) - 1 )
+    .option( COAP_CONTENT_FORMAT, (uint32_t)SENML_CONTENT_FORMAT )
+    .body()
+    .write( '[' );
+}
+
+// Fixed point value / 10^decimals as a decimal number
+static void print_fixed( Print& out, int32_t value, uint8_t decimals ) {
+  uint32_t scale = decimals == 3 ? 1000 : 100;
+  if ( value < 0 ) {
+    out.write( '-' );
+    value = -value;
+  }
+  out.print( (unsigned long)value / scale );
+  out.write( '.' );
+  char digits[4];
+  uint32_t fraction = value % scale;
+  for ( int8_t i = decimals - 1; i >= 0; i-- ) {
+    digits[i] = '0' + fraction % 10;
+    fraction /= 10;
+  }
+  out.write( (const uint8_t*)digits, decimals );
+}
+
+// The first record of a sample carries its time as the base time, the
+// other three inherit it
+void SenmlPush::write_sample( const senml_sample_t& s, bool first ) {
+  Print& out = udp;
+  static const char* const names[] = { "volume", "flow", "filling", "transferring" };
+  for ( uint8_t i = 0; i < 4; i++ ) {
+    out.print( first && i == 0 ? F( "{" ) : F( ",{" ) );
+    if ( first && i == 0 ) {
+      out.print( F( "\"bn\":\"" ) );
+      out.print( base_name );
+      out.print( F( "\"," ) );
+    }
+    if ( i == 0 ) {
+      out.print( F( "\"bt\":" ) );
+      print_fixed( out, -(int32_t)( sent_at - s.timestamp ), 3 );
+      out.write( ',' );
+    }
+    out.print( F( "\"n\":\"" ) );
+    out.print( s.tank );
+    out.write( '/' );
+    out.print( names[i] );
+    switch ( i ) {
+      case 0:
+        out.print( F( "\",\"u\":\"l\",\"v\":" ) );
+        print_fixed( out, s.volume, 2 );
+        break;
+      case 1:
+        out.print( F( "\",\"u\":\"l/s\",\"v\":" ) );
+        print_fixed( out, s.flow, 2 );
+        break;
+      default:
+        out.print( F( "\",\"vb\":" ) );
+        out.print( ( i == 2 ? s.filling : s.transferring ) ? F( "true" ) : F( "false" ) );
+        break;
+    }
+    out.write( '}' );
+  }
+  counters.samples++;
+}
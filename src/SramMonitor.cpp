@@ -0,0 +1,144 @@
+#include "SramMonitor.hpp"
+
+#include <avr/io.h>
+
+// avr-libc allocator internals
+struct __freelist {
+  size_t sz;
+  struct __freelist* nx;
+};
+
+extern struct __freelist* __flp;
+extern char* __brkval;
+extern char __heap_start;
+extern char* __malloc_heap_start;
+extern size_t __malloc_margin;
+
+// Runs from .init1, before the C runtime clears r1 and sets the stack
+// pointer, so it cannot touch the stack: plain asm from the end of
+// .bss/.noinit up to RAMEND.
+void sram_paint( void ) __attribute__( ( naked, used, section( ".init1" ) ) );
+
+void sram_paint( void ) {
+  __asm volatile(
+    "  ldi r30, lo8(__heap_start)\n"
+    "  ldi r31, hi8(__heap_start)\n"
+    "  ldi r24, %0\n"
+    "  ldi r25, hi8(__stack)\n"
+    "  rjmp 2f\n"
+    "1:\n"
+    "  st Z+, r24\n"
+    "2:\n"
+    "  cpi r30, lo8(__stack)\n"
+    "  cpc r31, r25\n"
+    "  brlo 1b\n"
+    "  breq 1b\n"
+    :: "M" ( SRAM_CANARY ) );
+}
+
+SramMonitor& SramMonitor::begin( void ) {
+  low = (uint8_t*)RAMEND + 1;
+  heap_peak = (uint8_t*)__malloc_heap_start;
+  cursor = heap_peak;
+  memset( probes, 0, sizeof( probes ) );
+  return *this;
+}
+
+// Top of the heap, also the start of the painted area. Remembers the
+// highest value: a freed top chunk lowers __brkval but leaves its bytes
+// dirty, they must not pass for stack.
+uint8_t* SramMonitor::heap_top( void ) {
+  uint8_t* top = (uint8_t*)( __brkval ? __brkval : __malloc_heap_start );
+  if ( top > heap_peak ) {
+    heap_peak = top;
+  }
+  return top;
+}
+
+uint8_t* SramMonitor::first_dirty( uint8_t* from, uint8_t* to ) {
+  while ( from < to && *from == SRAM_CANARY ) {
+    from++;
+  }
+  return from;
+}
+
+// Continues the upward walk from the heap to the current mark, at most
+// SRAM_SCAN_CHUNK bytes
+void SramMonitor::scan( void ) {
+  heap_top();
+  if ( cursor < heap_peak ) {
+    cursor = heap_peak;
+  }
+  uint8_t* end = cursor + SRAM_SCAN_CHUNK < low ? cursor + SRAM_SCAN_CHUNK : low;
+  cursor = first_dirty( cursor, end );
+  if ( cursor < low && cursor < end ) {
+    low = cursor;
+  }
+  if ( cursor >= end && end < low ) {
+    return;
+  }
+  cursor = heap_peak;
+}
+
+// .data and .bss, fixed at link time
+uint16_t SramMonitor::static_size( void ) {
+  return &__heap_start - (char*)RAMSTART;
+}
+
+// Deepest stack since boot, in bytes below RAMEND
+uint16_t SramMonitor::stack_peak( void ) {
+  return (uint8_t*)RAMEND + 1 - low;
+}
+
+// Bytes neither the heap nor the stack have ever reached
+uint16_t SramMonitor::unused( void ) {
+  return low > heap_peak ? low - heap_peak : 0;
+}
+
+void SramMonitor::heap( sram_heap_t& h ) {
+  uint8_t* top = heap_top();
+  h.used = top - (uint8_t*)__malloc_heap_start;
+  h.free_list = 0;
+  h.fragments = 0;
+  h.largest = 0;
+  for ( struct __freelist* f = __flp; f; f = f->nx ) {
+    h.free_list += f->sz;
+    h.fragments++;
+    if ( f->sz > h.largest ) {
+      h.largest = f->sz;
+    }
+  }
+  // Same limit as malloc() growing the heap, minus the chunk header
+  uint8_t* limit = (uint8_t*)SP - __malloc_margin;
+  if ( limit > top + sizeof( size_t ) && (uint16_t)( limit - top - sizeof( size_t ) ) > h.largest ) {
+    h.largest = limit - top - sizeof( size_t );
+  }
+}
+
+// Records the stack so far, then repaints everything below the stack
+// pointer
+void SramMonitor::probe_begin( void ) {
+  uint8_t* top = heap_top();
+  uint8_t* dirty = first_dirty( heap_peak, low );
+  if ( dirty < low ) {
+    low = dirty;
+  }
+  probe_sp = (uint8_t*)SP;
+  for ( uint8_t* p = top; p < probe_sp; p++ ) {
+    *p = SRAM_CANARY;
+  }
+  cursor = heap_peak;
+}
+
+// Stack used since probe_begin(), measured from the stack pointer it saw
+void SramMonitor::probe_end( uint8_t slot ) {
+  heap_top();
+  uint8_t* dirty = first_dirty( heap_peak, probe_sp );
+  if ( dirty < low ) {
+    low = dirty;
+  }
+  uint16_t depth = dirty < probe_sp ? probe_sp - dirty : 0;
+  if ( depth > probes[slot] ) {
+    probes[slot] = depth;
+  }
+}
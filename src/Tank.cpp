@@ -0,0 +1,100 @@
+#include "Tank.hpp"
+
+// Sensor first, so that control starts from a volume. The flags only
+// drive the relays, control keeps them exclusive.
+Tank& Tank::begin( uint8_t channel, const tank_pins_t& pins, const tank_config_t& config, uint8_t oversample ) {
+  control.begin( config.max_volume );
+
+  sensor.begin( 10, channel )
+    .calibrate( config.calibration )
+    .oversample( oversample )
+    .window( window )
+    .estimate( estimator, filling, transferring )
+    .deadtime( dead_time.begin() )
+    .threshold( VOLUME_DEADBAND );  // ignore jitter
+
+  // Flags
+  filling.begin()
+    .onChange( true, water_in_relay, water_in_relay.EVT_ON )
+    .onChange( false, water_in_relay, water_in_relay.EVT_OFF )
+    .off();
+
+  transferring.begin()
+    .onChange( true, water_out_relay, water_out_relay.EVT_ON )
+    .onChange( false, water_out_relay, water_out_relay.EVT_OFF )
+    .off();
+
+  // Water in/out pump relay
+  water_in_relay.begin( pins.water_in, false ).off();
+  water_out_relay.begin( pins.water_out, true ).off();
+  return *this;
+}
+
+// New calibration and max_volume, both in effect now
+Tank& Tank::configure( const tank_config_t& config ) {
+  sensor.calibrate( config.calibration );
+  control.max_volume = config.max_volume;
+  return *this;
+}
+
+// Starts filling up to target, false (and stopped) if out of range
+bool Tank::fill( int target ) {
+  bool ok = control.fill( target );
+  apply();
+  return ok;
+}
+
+// Starts transferring amount, false (and stopped) if the tank holds
+// less
+bool Tank::transfer( int amount ) {
+  bool ok = control.transfer( amount, volume() );
+  apply();
+  return ok;
+}
+
+void Tank::stop_filling( void ) {
+  control.stop_filling();
+  apply();
+}
+
+void Tank::stop_transferring( void ) {
+  control.stop_transferring();
+  apply();
+}
+
+// Re-zeros the sensor from the sample window, the tank must be empty
+bool Tank::zero( uint8_t source ) {
+  return sensor.zero( source );
+}
+
+// Sets the flags, and so the relays, to the pump control picked. The
+// one turning off goes first.
+void Tank::apply( void ) {
+  int8_t pump = control.pumping();
+  if ( filling.state() && pump <= 0 ) {
+    filling.off();
+  }
+  if ( transferring.state() && pump >= 0 ) {
+    transferring.off();
+  }
+  if ( !filling.state() && pump > 0 ) {
+    filling.on();
+  }
+  if ( !transferring.state() && pump < 0 ) {
+    transferring.on();
+  }
+}
+
+// Runs control against the volume of now, on every loop() so that a
+// limit is acted on as soon as it is sampled and the command time is
+// not rounded to a sample period when dead_time stamps the relay edge.
+// Re-zeros once control finds the tank drained and settled.
+void Tank::poll( void ) {
+  uint32_t now = millis();
+  bool drained = control.run( volume(), sensor.flow(), now, window );
+  apply();
+  dead_time.edge( control.pumping(), now, volume(), sensor.flow() );
+  if ( drained ) {
+    zero( ZERO_EMPTY );
+  }
+}
@@ -0,0 +1,72 @@
+#include "TankControl.hpp"
+
+void TankControl::begin( int max_volume ) {
+  this->max_volume = max_volume;
+  fill_target = 0;
+  tx_amount = 0;
+  pump = last_pump = 0;
+  drained = false;
+}
+
+// Starts filling up to target, false (and stopped) if out of range.
+// Filling stops a transfer.
+bool TankControl::fill( int target ) {
+  if ( fill_valid( target ) ) {
+    fill_target = target;
+    pump = 1;
+    return true;
+  }
+  fill_target = 0;
+  stop_filling();
+  return false;
+}
+
+// Starts transferring amount, false (and stopped) if the tank holds
+// less. Transferring stops filling.
+bool TankControl::transfer( int amount, int volume ) {
+  tx_amount = amount;
+  if ( transfer_valid( amount, volume ) ) {
+    pump = -1;
+    return true;
+  }
+  stop_transferring();
+  return false;
+}
+
+void TankControl::stop_filling( void ) {
+  if ( pump > 0 ) {
+    pump = 0;
+  }
+}
+
+void TankControl::stop_transferring( void ) {
+  if ( pump < 0 ) {
+    pump = 0;
+  }
+}
+
+// Stops filling at the target or when the tank is full, and
+// transferring when it is empty, from the fill_target and max_volume of
+// now. Then waits for a drained tank to settle: true once it has, the
+// caller re-zeros from the window. The flow is only checked then, at
+// the edge the estimator still has the transfer's.
+bool TankControl::run( int volume, int flow, uint32_t now, SampleWindow& window ) {
+  if ( pump > 0 && ( volume >= fill_target * 10 || volume >= max_volume ) ) {
+    pump = 0;
+  }
+  if ( pump < 0 && volume < TANK_EMPTY ) {
+    pump = 0;
+  }
+  if ( pump != last_pump ) {
+    drained = last_pump < 0 && pump == 0 && volume < AUTOZERO_EMPTY;
+    drained_at = now;
+    last_pump = pump;
+  }
+  if ( drained && now - drained_at >= AUTOZERO_SETTLE &&
+       flow > -AUTOZERO_FLOW && flow < AUTOZERO_FLOW &&
+       window.count() == SAMPLE_WINDOW_SIZE && window.variance() <= AUTOZERO_MAX_SD * AUTOZERO_MAX_SD ) {
+    drained = false;
+    return volume > -AUTOZERO_EMPTY && volume < AUTOZERO_EMPTY;
+  }
+  return false;
+}
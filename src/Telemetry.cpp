@@ -0,0 +1,63 @@
+#include "Telemetry.hpp"
+
+Telemetry& Telemetry::begin( HardwareSerial& port, uint16_t interval ) {
+  this->port = &port;
+  this->interval = interval;
+  last = millis();
+  head = tail = 0;
+  seq = 0;
+  drops = 0;
+  return *this;
+}
+
+// True once per interval
+bool Telemetry::due( void ) {
+  uint32_t now = millis();
+  if ( now - last < interval ) {
+    return false;
+  }
+  last = now;
+  return true;
+}
+
+void Telemetry::put( uint8_t b ) {
+  buf[head] = b;
+  head = ( head + 1 ) & ( TELEMETRY_BUFFER_SIZE - 1 );
+}
+
+// COBS encodes the record straight into the ring, followed by the 0x00
+// delimiter. Records must be shorter than 254 bytes.
+bool Telemetry::send( void* record, uint8_t len ) {
+  // One code byte per started 254-byte block plus the delimiter
+  if ( TELEMETRY_BUFFER_SIZE - 1 - used() < len + 2 ) {
+    drops++;
+    return false;
+  }
+  const uint8_t* p = (const uint8_t*)record;
+  uint8_t code_pos = head;
+  uint8_t code = 1;
+  put( 0 );
+  for ( uint8_t i = 0; i < len; i++ ) {
+    if ( p[i] == 0 ) {
+      buf[code_pos] = code;
+      code_pos = head;
+      code = 1;
+      put( 0 );
+    } else {
+      put( p[i] );
+      code++;
+    }
+  }
+  buf[code_pos] = code;
+  put( 0 );
+  return true;
+}
+
+// Writes what the UART TX buffer can take right now, never blocks
+void Telemetry::drain( void ) {
+  int room = port->availableForWrite();
+  while ( room-- > 0 && tail != head ) {
+    port->write( buf[tail] );
+    tail = ( tail + 1 ) & ( TELEMETRY_BUFFER_SIZE - 1 );
+  }
+}
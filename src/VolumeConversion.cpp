@@ -0,0 +1,326 @@
+#include "VolumeConversion.hpp"
+
+#include <math.h>
+#include <stdlib.h>
+
+// Transmitter calibration and tank geometry. The zero drifts with
+// temperature and age, see trim().
+// 6369 : 4mA
+// 6760 : atmo
+// const int ma_at_cylinder_bottom = 8140; // = 32 liters are contained in bottom part, not linear
+const volume_calibration_t volume_calibration_default = {
+  0,                  // Auto-ranging
+  428, 2048, 35000,   // Map 428-2048mV to 0-35kpa
+  450,                // mm ... 93cm diam
+  810,                // Account for non linear first 32 liters.
+};
+
+// PGA ranges, widest first, in the order of the gains in
+// Atm_volume_sensor.cpp. Codes are scaled to the LSB of the narrowest
+// range (7.8125 uV) before they are summed or converted, so samples
+// taken at different gains add up.
+static const struct {
+  uint16_t full_scale_mv;
+  uint8_t lsb;  // in 7.8125 uV steps
+} pga_ranges[PGA_RANGES] = {
+  { 6144, 24 },
+  { 4096, 16 },
+  { 2048, 8 },
+  { 1024, 4 },
+  { 512, 2 },
+  { 256, 1 },
+};
+
+// Auto-ranging thresholds on the raw code, with hysteresis: a code
+// above PGA_WIDEN_CODE switches to the next wider range at once; at the
+// end of an output sample, the next narrower range is taken if every
+// code would have stayed under PGA_NARROW_CODE there.
+#define PGA_WIDEN_CODE 30000   // 92% of full scale
+#define PGA_NARROW_CODE 26000  // 79% of full scale
+
+static bool pga_range( uint16_t full_scale_mv, uint8_t& range ) {
+  for ( range = 0; range < PGA_RANGES; range++ ) {
+    if ( pga_ranges[range].full_scale_mv == full_scale_mv ) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool VolumeConversion::calibration_valid( const volume_calibration_t& c ) {
+  uint8_t r;
+  bool fixed = c.full_scale_mv != 0;
+  return ( !fixed || ( pga_range( c.full_scale_mv, r ) && c.zero_mv < c.full_scale_mv ) ) &&
+    c.zero_mv < c.span_mv && c.span_mv <= pga_ranges[0].full_scale_mv &&
+    c.span_pascal > 0 && c.tank_radius_mm > 0;
+}
+
+// ADC code at 0 kPa, and cl per ADC code in Q20, both in 7.8125 uV steps:
+// pascal / 9.80665 = column heigh in mm, H * PI * r^2 / 10 = volume in cl.
+// A full_scale_mv of 0 turns auto-ranging on, starting from the
+// narrowest range that covers span_mv. Invalid calibrations are ignored
+// and return false, otherwise the caller writes the ADC config.
+bool VolumeConversion::calibrate( const volume_calibration_t& c ) {
+  if ( !calibration_valid( c ) ) {
+    return false;
+  }
+  // In float throughout, double is float on the AVR: the host and the
+  // replay get the same constants as the board
+  float mv_per_code = pga_ranges[PGA_RANGES - 1].full_scale_mv / 32768.0f;
+  float tank_radius = c.tank_radius_mm / 100.0f;  // dm
+  zero_code = c.zero_mv / mv_per_code + trim_codes;
+  cl_per_code_q20 =
+    mv_per_code * c.span_pascal / ( c.span_mv - c.zero_mv ) / 9.80665f * (float)M_PI * tank_radius * tank_radius / 10.0f * 1048576 + 0.5f;
+  volume_offset = c.volume_offset;
+
+  uint8_t r;
+  autoranging = c.full_scale_mv == 0;
+  if ( autoranging ) {
+    for ( r = PGA_RANGES - 1; r > 0 && pga_ranges[r].full_scale_mv < c.span_mv; r-- ) {
+    }
+  } else {
+    pga_range( c.full_scale_mv, r );
+  }
+  select( r );
+  // Codes summed with the previous calibration are lost
+  os_total = 0;
+  os_count = 0;
+  os_peak = 0;
+  os_error = false;
+  return true;
+}
+
+void VolumeConversion::oversample( uint8_t shift ) {
+  os_shift = shift;
+  os_count = 0;
+  os_total = 0;
+  os_error = false;
+}
+
+// Time between two output samples, for the estimator. restart also
+// starts the estimator afresh.
+void VolumeConversion::period( uint16_t ms, bool restart ) {
+  period_ms = ms;
+  if ( estimator && restart ) {
+    estimator->begin( ms );
+  } else if ( estimator ) {
+    estimator->period( ms );
+  }
+}
+
+// Publishes the estimator's volume instead of the measured one
+void VolumeConversion::estimate( VolumeEstimator* e ) {
+  estimator = e;
+  estimator->begin( period_ms );
+}
+
+// Starts the estimator from a saved state instead of the first
+// measurement, after estimate()
+void VolumeConversion::warm( const estimator_state_t& s ) {
+  if ( estimator ) {
+    estimator->restore( s );
+    v_sample = v_published = estimator->volume();
+  }
+}
+
+// Averages the output over the size / 2 samples v is filled with
+void VolumeConversion::average( uint16_t* v, uint16_t size ) {
+  avg_buf = v;
+  avg_buf_size = size / sizeof( uint16_t );
+  avg_buf_head = 0;
+  avg_buf_total = 0;
+  for ( uint16_t i = 0; i < avg_buf_size; i++ ) {
+    avg_buf_total += avg_buf[i];
+  }
+}
+
+// Moves the zero by codes (7.8125 uV steps) from the calibrated one.
+// It is folded into zero_code, convert() does not pay for it. Refused
+// beyond ZERO_TRIM_LIMIT.
+bool VolumeConversion::trim( int16_t codes, uint8_t source ) {
+  if ( codes > ZERO_TRIM_LIMIT || codes < -ZERO_TRIM_LIMIT ) {
+    return false;
+  }
+  zero_code += codes - trim_codes;
+  trim_codes = codes;
+  trim_source = source;
+  return true;
+}
+
+// Re-zeros from the volume measured in an empty tank, which should
+// read 0: a tank a transfer drained still holds the bottom the pump
+// cannot reach, it does not read -volume_offset like the atmosphere
+bool VolumeConversion::zero_at( int measured, uint8_t source ) {
+  int32_t drift = ( (int32_t)measured << 20 ) / cl_per_code_q20;
+  return drift >= -ZERO_TRIM_LIMIT && drift <= ZERO_TRIM_LIMIT && trim( trim_codes + drift, source );
+}
+
+// Re-zeros from the mean of the sample window, the tank must be empty
+bool VolumeConversion::zero( uint8_t source ) {
+  return sample_window && sample_window->count() > 0 && zero_at( round( sample_window->mean() ), source );
+}
+
+// Re-zeros against a reference on AIN3 at the transmitter's 0 Pa
+// output, at any level: the next output sample is taken as AIN<n> -
+// AIN3, that is the pressure signal, so the last single-ended sample
+// minus it is the zero. The caller writes the differential config.
+bool VolumeConversion::reference( void ) {
+  if ( ref_pending || !last_ok ) {
+    return false;
+  }
+  ref_pending = true;
+  os_total = 0;
+  os_count = 0;
+  os_error = false;
+  settle();
+  return true;
+}
+
+void VolumeConversion::reference_done( bool ok, int32_t diff ) {
+  ref_pending = false;
+  os_peak = 0;
+  int32_t codes = trim_codes + ( last_scaled - diff ) - zero_code;
+  if ( ok && codes >= -ZERO_TRIM_LIMIT && codes <= ZERO_TRIM_LIMIT ) {
+    trim( codes, ZERO_REFERENCE );
+  }
+  settle();
+}
+
+// Switches the PGA, the conversions in flight are dropped
+void VolumeConversion::select( uint8_t r ) {
+  pga_index = r;
+  settle();
+}
+
+// Current PGA full scale, in mV
+uint16_t VolumeConversion::full_scale( void ) {
+  return pga_ranges[pga_index].full_scale_mv;
+}
+
+// Current PGA LSB, in 7.8125 uV steps
+uint8_t VolumeConversion::lsb( void ) {
+  return pga_ranges[pga_index].lsb;
+}
+
+// Picks the next narrower range if the codes seen since the last call,
+// scaled, would all have stayed under PGA_NARROW_CODE in it
+bool VolumeConversion::narrow( void ) {
+  bool narrower = autoranging && pga_index + 1 < PGA_RANGES &&
+    os_peak < (int32_t)PGA_NARROW_CODE * pga_ranges[pga_index + 1].lsb;
+  if ( narrower ) {
+    select( pga_index + 1 );
+  }
+  os_peak = 0;
+  return narrower;
+}
+
+// Converts the sum of (1 << shift) scaled ADC codes to a volume in cl
+int VolumeConversion::convert( int32_t codes, uint8_t shift ) {
+  int64_t cl = (int64_t)( codes - ( zero_code << shift ) ) * cl_per_code_q20;
+  return ( ( cl + ( (int64_t)1 << ( 19 + shift ) ) ) >> ( 20 + shift ) ) - volume_offset;
+}
+
+// One code, false ok for a failed read. When oversampling the codes
+// are accumulated and the volume is only computed once every
+// (1 << os_shift) codes. The output sample is taken at time now with
+// the pumps in the given state. Returns TAKE_ flags.
+uint8_t VolumeConversion::take( bool ok, int16_t code, uint32_t now, int8_t pumping ) {
+  int v;
+  int32_t scaled = 0;
+  if ( settling > 0 ) {
+    settling--;
+    return 0;
+  }
+  if ( os_count == 0 ) {
+    os_first = now;
+  }
+  if ( ok ) {
+    v_code = code;
+    if ( autoranging && pga_index > 0 && ( code > PGA_WIDEN_CODE || code < -PGA_WIDEN_CODE ) ) {
+      // May be clipped, dropped like the conversions that follow
+      select( pga_index - 1 );
+      return TAKE_CONFIG;
+    }
+    scaled = (int32_t)code * pga_ranges[pga_index].lsb;
+    if ( labs( scaled ) > os_peak ) {
+      os_peak = labs( scaled );
+    }
+  }
+  if ( os_shift > 0 ) {
+    if ( ok ) {
+      os_total += scaled;
+    } else {
+      os_error = true;
+    }
+    if ( ++os_count < ( (uint16_t)1 << os_shift ) ) {
+      return 0;
+    }
+    ok = !os_error;
+    scaled = os_total >> os_shift;
+    v = ok ? convert( os_total, os_shift ) : 0;
+    os_total = 0;
+    os_count = 0;
+    os_error = false;
+    code = scaled / pga_ranges[pga_index].lsb;
+  } else {
+    v = ok ? convert( scaled, 0 ) : 0;
+  }
+  if ( ref_pending ) {
+    // A differential sample, not a volume. Back to single-ended.
+    reference_done( ok, scaled );
+    return TAKE_CONFIG | TAKE_PASS;
+  }
+  last_ok = ok;
+  last_scaled = scaled;
+  uint8_t flags = TAKE_SAMPLE | TAKE_PASS;
+  if ( ok && narrow() ) {
+    flags |= TAKE_CONFIG;
+  }
+  if ( avg_buf_size > 0 ) {
+    v = avg( v );
+  }
+  v_sample = publish( now, code, v, pumping );
+  v_fresh = true;
+  return flags;
+}
+
+// Adds a measured output sample to the statistics window and the
+// dead-time detector, and runs it through the estimator if there is one
+int VolumeConversion::publish( uint32_t now, int16_t code, int v, int8_t pumping ) {
+  if ( sample_window ) {
+    sample_window->push( now, code, v );
+  }
+  if ( dead_time ) {
+    // The sample averages its own conversions, stamped halfway. With
+    // several tanks the period also holds the other sensors' turns.
+    dead_time->sample( v, now - ( now - os_first ) / 2 );
+  }
+  if ( estimator ) {
+    v = estimator->update( v, pumping );
+  }
+  return v;
+}
+
+int VolumeConversion::flow( void ) {
+  return estimator ? estimator->flow() : 0;
+}
+
+int VolumeConversion::avg( int v ) {
+  avg_buf_total = avg_buf_total + (uint16_t)v - avg_buf[avg_buf_head];
+  avg_buf[avg_buf_head] = v;
+  if ( avg_buf_head + 1 >= avg_buf_size ) {
+    avg_buf_head = 0;
+  } else {
+    avg_buf_head++;
+  }
+  return avg_buf_total / avg_buf_size;
+}
+
+bool VolumeConversion::due( void ) {
+  return v_fresh && abs( v_sample - v_published ) > v_threshold;
+}
+
+void VolumeConversion::sent( void ) {
+  v_published = v_sample;
+  v_fresh = false;
+}
@@ -0,0 +1,82 @@
+#include "VolumeEstimator.hpp"
+
+// Largest residual fed to the gains, keeps the Q12 products in 32 bits
+#define RESIDUAL_LIMIT ( (int32_t)1 << 20 )
+
+VolumeEstimator& VolumeEstimator::begin( uint16_t period_ms, int16_t alpha, int16_t beta ) {
+  this->period_ms = period_ms;
+  this->alpha = alpha;
+  this->beta = beta;
+  learned_in = learned_out = 0;
+  primed = false;
+  warm = false;
+  return *this;
+}
+
+void VolumeEstimator::save( estimator_state_t& s ) {
+  s.x = x;
+  s.learned_in = learned_in;
+  s.learned_out = learned_out;
+}
+
+// Resumes from a saved state with both pumps off, after begin()
+VolumeEstimator& VolumeEstimator::restore( const estimator_state_t& s ) {
+  x = s.x;
+  v = 0;
+  learned_in = s.learned_in;
+  learned_out = s.learned_out;
+  last_pumping = 0;
+  primed = true;
+  warm = true;
+  return *this;
+}
+
+// pumping: > 0 filling, < 0 transferring, 0 idle
+int16_t VolumeEstimator::update( int16_t measured, int8_t pumping ) {
+  int32_t z = (int32_t)measured << 8;
+
+  if ( warm ) {
+    // The tank may have moved while the board was off
+    warm = false;
+    int32_t r = z - x;
+    if ( r > ( (int32_t)ESTIMATOR_WARM_GATE << 8 ) || r < -( (int32_t)ESTIMATOR_WARM_GATE << 8 ) ) {
+      primed = false;
+    }
+  }
+
+  if ( !primed ) {
+    x = z;
+    v = 0;
+    last_pumping = pumping;
+    primed = true;
+    return measured;
+  }
+
+  if ( pumping != last_pumping ) {
+    if ( last_pumping > 0 ) learned_in = v;
+    if ( last_pumping < 0 ) learned_out = v;
+    v = pumping > 0 ? learned_in : ( pumping < 0 ? learned_out : 0 );
+    last_pumping = pumping;
+  }
+
+  // Predict
+  x += v;
+
+  // Correct
+  int32_t r = z - x;
+  if ( r > RESIDUAL_LIMIT ) r = RESIDUAL_LIMIT;
+  if ( r < -RESIDUAL_LIMIT ) r = -RESIDUAL_LIMIT;
+  x += ( r * alpha ) >> 12;
+  v += ( r * beta ) >> 12;
+
+  // Control input constraints
+  if ( pumping == 0 || ( pumping > 0 && v < 0 ) || ( pumping < 0 && v > 0 ) ) {
+    v = 0;
+  }
+
+  return volume();
+}
+
+int16_t VolumeEstimator::flow( void ) {
+  return ( v * 1000 / period_ms + 128 ) >> 8;
+}
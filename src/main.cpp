@@ -1,5 +1,16 @@
 //#define USE_LCD
 #define USE_COAP
+#ifndef HOST_BUILD // hardware host/ has no stand-in for
+#define USE_TELEMETRY
+#define USE_SAMPLE_CLOCK
+#define USE_SRAM_MONITOR
+#define USE_IDLE_SLEEP
+#endif
+#define USE_SENML_PUSH
+
+#if defined(USE_SENML_PUSH) && !defined(USE_COAP)
+#error "USE_SENML_PUSH needs USE_COAP"
+#endif
 
 #include <Arduino.h>
 #include <avr/wdt.h>
@@ -10,6 +21,9 @@
 #include <menu.hpp>
 #include <menuIO/chainStream.h>
 #include <menuIO/U8x8Out.h>
+
+#include "PinEvents.hpp"
+#include "TileText.hpp"
 #endif
 
 #ifdef USE_COAP
@@ -19,18 +33,58 @@
 
 #include <coap.h>
 
+#include "CoapDedup.hpp"
+#include "CoapIngress.hpp"
+#include "CoapResponse.hpp"
+
+#ifdef USE_SENML_PUSH
+#include "SenmlPush.hpp"
+#endif
+
 #endif
 
 
 #include "Atm_volume_sensor.hpp"
+#include "EepromRing.hpp"
+#include "Scheduler.hpp"
+#include "Tank.hpp"
+
+#ifdef USE_TELEMETRY
+#include "Telemetry.hpp"
+#endif
+
+#ifdef USE_SRAM_MONITOR
+#include "SramMonitor.hpp"
+#endif
+
+#ifdef USE_IDLE_SLEEP
+#include "IdleSleep.hpp"
+#endif
 
 #ifdef USE_COAP
 // Ethernet setup
 byte mac[] = { 0x90, 0xA2, 0xDA, 0x0E, 0xFE, 0x40 };
 
-// UDP and CoAP class
+// Requests handled per loop(), the rest waits in the ingress queue
+#define COAP_REQUESTS_PER_LOOP 1
+
+// UDP and CoAP class, requests go through a bounded queue
 EthernetUDP Udp;
-Coap coap(Udp);
+CoapIngress ingress(Udp);
+Coap coap(ingress);
+
+// Responses to recent commands, replayed on retransmission
+CoapDedup dedup;
+
+#ifdef USE_SENML_PUSH
+// Pushes go out from a socket of their own, so that a batch being
+// written does not hold the server socket
+#define SENML_LOCAL_PORT 5700
+
+EthernetUDP push_udp;
+SenmlPush push(push_udp);
+char push_base_name[30]; // urn:dev:mac:<mac>:
+#endif
 
 #endif
 
@@ -45,52 +99,439 @@ Coap coap(Udp);
 
 #define MAX_DEPTH 2
 
+// Minimum time between two idle screen refreshes, in ms
+#define DISPLAY_FRAME_INTERVAL 200
+
 #endif
 
-#define WATER_IN_RELAY_PIN 2
-#define WATER_OUT_RELAY_PIN 3
+// Vessels driven by this board, tank n reads ADS1115 AIN<n>. A tank
+// holds its own sensor, sample window, estimator and machines, several
+// hundred bytes of SRAM: check /sram when adding one. The native
+// build runs two, see platformio.ini.
+#ifndef TANK_COUNT
+#define TANK_COUNT 1
+#endif
+
+// Water in / water out relay pins per tank
+const tank_pins_t tank_pins[] = {
+  { 2, 3 },
+  { A0, A1 },
+  { A2, A3 },
+};
+
+static_assert(TANK_COUNT <= sizeof(tank_pins) / sizeof(tank_pins[0]), "no relay pins for every tank");
 
 #define BUTTON_PIN 8
+#define ENCODER_A_PIN 7
+#define ENCODER_B_PIN 6
+
+Tank tanks[TANK_COUNT];
+
+// Settings kept in EEPROM, changed through /config. The single tank
+// layout is the one of version 1.
+#define CONFIG_VERSION (TANK_COUNT == 1 ? 1 : 0x10 + TANK_COUNT)
+
+struct hlt_config_t {
+  tank_config_t tank[TANK_COUNT];
+  uint8_t oversample;  // log2 of ADC conversions per volume sample
+};
+
+// Estimator states and zero trims, saved when one moved and restored
+// at boot
+#define SNAPSHOT_VERSION (TANK_COUNT == 1 ? 2 : 0x20 + TANK_COUNT)
+#define SNAPSHOT_INTERVAL 60000  // ms
+#define SNAPSHOT_DEADBAND 5      // cl
+
+struct snapshot_t {
+  estimator_state_t estimator[TANK_COUNT];
+  int16_t zero_trim[TANK_COUNT];  // 7.8125 uV codes
+};
+
+// EEPROM layout: config slots from 0, snapshot slots from 128 or right
+// after the config when it is larger
+hlt_config_t config;
+EepromRing<hlt_config_t, 0, 4> config_store;
+#define SNAPSHOT_BASE (decltype(config_store)::end > 128 ? decltype(config_store)::end : 128)
+#define SNAPSHOT_SLOTS (TANK_COUNT > 2 ? 8 : 16)
+EepromRing<snapshot_t, SNAPSHOT_BASE, SNAPSHOT_SLOTS> snapshot_store;
+snapshot_t snapshot_saved;
+uint32_t snapshot_last = 0;
+
+static_assert(decltype(snapshot_store)::end <= E2END + 1, "snapshot slots do not fit in EEPROM");
+
+#ifdef USE_SENML_PUSH
+// SenML collector, changed through /push. Kept in the last 64 bytes of
+// EEPROM, where a config or snapshot layout change cannot move it.
+#define PUSH_CONFIG_VERSION 1
+#define PUSH_BASE (E2END + 1 - 64)
+
+// Upper bounds of the /push settings, the lower ones are 1 s and 100 ms
+#define PUSH_INTERVAL_MAX 3600  // s
+#define PUSH_PERIOD_MAX 60000   // ms
+
+struct push_config_t {
+  uint8_t ip[4];        // 0.0.0.0: no pushing
+  uint16_t port;
+  uint16_t interval_s;  // longest wait for a batch to fill
+  uint16_t period_ms;   // between two samples of a tank
+};
+
+push_config_t push_config;
+EepromRing<push_config_t, PUSH_BASE, 4> push_store;
+
+static_assert(decltype(push_store)::end <= E2END + 1, "push slots do not fit in EEPROM");
+static_assert(decltype(snapshot_store)::end <= PUSH_BASE, "snapshot slots run into the push slots");
+
+void push_defaults(push_config_t& c) {
+  memset(&c, 0, sizeof(c));
+  c.port = 5683;
+  c.interval_s = 10;
+  c.period_ms = 1000;
+}
+
+bool push_valid(const push_config_t& c) {
+  return c.port > 0
+    && c.interval_s > 0 && c.interval_s <= PUSH_INTERVAL_MAX
+    && c.period_ms >= 100 && c.period_ms <= PUSH_PERIOD_MAX;
+}
 
-Atm_volume_sensor volume_sensor;
-Atm_led water_in_relay, water_out_relay;
-Atm_controller filling_controller, transferring_controller;
-Atm_encoder rotary;
-Atm_button button;
-Atm_bit filling, transferring;
+// Applies c to the pusher, a zero address stops it
+void push_apply(const push_config_t& c) {
+  IPAddress ip(c.ip[0], c.ip[1], c.ip[2], c.ip[3]);
+  push.collector(ip, ip == IPAddress(0, 0, 0, 0) ? 0 : c.port)
+    .interval(c.interval_s);
+}
+#endif
 
-// Global variables
-int fill_target = 0;
-int tx_amount = 0;
+void config_defaults(hlt_config_t& c) {
+  for (uint8_t i = 0; i < TANK_COUNT; i++) {
+    c.tank[i].calibration = volume_calibration_default;
+    c.tank[i].max_volume = 9000; // dL
+  }
+  c.oversample = 6; // 64 conversions at 860SPS per volume sample
+}
 
-// Average buffer for sensor
-uint16_t avgbuffer[16];
+bool config_valid(const hlt_config_t& c) {
+  for (uint8_t i = 0; i < TANK_COUNT; i++) {
+    if (!VolumeConversion::calibration_valid(c.tank[i].calibration) || c.tank[i].max_volume <= 0) {
+      return false;
+    }
+  }
+  return c.oversample <= 8;
+}
+
+// Loop tasks, see setup()
+#define LOOP_BUDGET_US 3000
+
+Scheduler scheduler;
+uint8_t task_run = NO_TASK, task_coap = NO_TASK, task_display = NO_TASK, task_telemetry = NO_TASK, task_sram = NO_TASK;
+
+// Task peaks are read on their own cadence by telemetry and /tasks
+enum { PEAK_TELEMETRY, PEAK_TASKS };
+
+// Longest run of a task since the previous telemetry sample
+uint16_t task_peak(uint8_t id) {
+  return id == NO_TASK ? 0 : scheduler.peak(id, PEAK_TELEMETRY);
+}
+
+#ifdef USE_SRAM_MONITOR
+// Stack and heap high-water marks
+SramMonitor sram;
+#endif
 
-const int max_volume = 9000; // dL
+#ifdef USE_TELEMETRY
+Telemetry telemetry;
+bool dhcp_failed;  // reported in the samples, text would break the stream
+
+void send_telemetry() {
+  telemetry_sample_t r;
+  r.type = TELEMETRY_SAMPLE;
+  r.seq = telemetry.next_seq();
+  r.timestamp = millis();
+  // First tank only
+  Tank& tank = tanks[0];
+  r.code = tank.sensor.code();
+  r.volume = tank.volume();
+  r.relays = (tank.filling.state() ? 1 : 0)
+    | (tank.transferring.state() ? 2 : 0)
+    | (digitalRead(tank_pins[0].water_in) ? 4 : 0)
+    | (digitalRead(tank_pins[0].water_out) ? 8 : 0)
+    | (tank.sensor.pga() << 4)
+    | (dhcp_failed ? 0x80 : 0);
+  r.phase[PHASE_OUTPUT] = task_peak(task_display);
+  r.phase[PHASE_COAP] = task_peak(task_coap);
+  r.phase[PHASE_RUN] = task_peak(task_run);
+#ifdef USE_SRAM_MONITOR
+  r.stack_peak = sram.stack_peak();
+  r.sram_unused = sram.unused();
+#else
+  r.stack_peak = 0;
+  r.sram_unused = 0;
+#endif
+  telemetry.send(&r, sizeof(r));
+}
+#endif
 
 enum error_no {X};
 
 #ifdef USE_COAP
 
+// Seconds a /status representation can be reused, about how long
+// the volume takes to move
+#define STATUS_MAX_AGE 1
+
+// Fields /status is built from, compared to detect changes. The window
+// statistics move with nearly every sample and are served by /window.
+struct status_t {
+  int volume;
+  int flow;
+  int fill_target;
+  int tx_amount;
+  uint8_t filling;
+  uint8_t transferring;
+};
+
+// Encoded /status of the tank asked last, rebuilt only when that tank
+// or its version changes. The version is the ETag. 113 characters with
+// every number at -32768.
+status_t status_snapshot[TANK_COUNT];
+uint16_t status_version[TANK_COUNT];
+char status_json[120];
+uint8_t status_json_len;
+uint8_t status_json_tank;
+
+// Bumps the version of tank n when any field changed, and re-encodes
+void status_refresh(uint8_t n) {
+  Tank& tank = tanks[n];
+  status_t now;
+  memset(&now, 0, sizeof(now));
+  now.volume = tank.volume();
+  now.flow = tank.sensor.flow();
+  now.fill_target = tank.control.fill_target;
+  now.tx_amount = tank.control.tx_amount;
+  now.filling = tank.filling.state();
+  now.transferring = tank.transferring.state();
+
+  bool changed = memcmp(&now, &status_snapshot[n], sizeof(now)) != 0;
+  if (status_json_len > 0 && status_json_tank == n && !changed) {
+    return;
+  }
+  if (changed) {
+    status_snapshot[n] = now;
+    status_version[n]++;
+  }
+  status_json_tank = n;
+
+  StaticJsonBuffer<220> jsonBuffer;
+
+  JsonObject& root = jsonBuffer.createObject();
+  root[F("volume")] = now.volume;
+  root[F("flow")] = now.flow;
+  root[F("filling")] = now.filling;
+  root[F("filling_target")] = now.fill_target;
+  root[F("transferring")] = now.transferring;
+  root[F("transferring_amount")] = now.tx_amount;
+
+  status_json_len = root.printTo(status_json, sizeof(status_json));
+}
+
+// True if the request carries the ETag of the current representation
+bool etag_matches(CoapPacket &packet, const uint8_t* etag) {
+  for (uint8_t i = 0; i < packet.optionnum; i++) {
+    CoapOption &o = packet.options[i];
+    if (o.number == COAP_E_TAG && o.length == 2 && memcmp(o.buffer, etag, 2) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Tank addressed by the request, see CoapIngress::collection(). Answers
+// 4.04 and returns NULL when there is no such tank.
+Tank* request_tank(CoapPacket &packet, IPAddress ip, int port) {
+  if (ingress.index() < TANK_COUNT) {
+    return &tanks[ingress.index()];
+  }
+  coap.sendResponse(ip, port, packet.messageid, NULL, 0, COAP_NOT_FOUNT, COAP_NONE, NULL, 0);
+  return NULL;
+}
+
 // CoAP server endpoint URL
 callback callback_status(CoapPacket &packet, IPAddress ip, int port) {
-  StaticJsonBuffer<200> jsonBuffer;
+  if (!request_tank(packet, ip, port)) {
+    return NULL;
+  }
+  uint8_t n = ingress.index();
+  status_refresh(n);
+
+  uint8_t etag[2] = { (uint8_t)(status_version[n] >> 8), (uint8_t)(status_version[n] & 0xFF) };
+  CoapResponse response(Udp);
+
+  if (etag_matches(packet, etag)) {
+    // Client copy is still current, 2.03 without payload
+    response.begin(packet, ip, port, COAP_VALID)
+      .option(COAP_E_TAG, etag, sizeof(etag))
+      .option(COAP_MAX_AGE, (uint32_t)STATUS_MAX_AGE)
+      .send();
+  } else {
+    response.begin(packet, ip, port, COAP_CONTENT)
+      .option(COAP_E_TAG, etag, sizeof(etag))
+      .option(COAP_CONTENT_FORMAT, (uint32_t)COAP_APPLICATION_JSON)
+      .option(COAP_MAX_AGE, (uint32_t)STATUS_MAX_AGE)
+      .payload((const uint8_t*)status_json, status_json_len)
+      .send();
+  }
+  return NULL;
+}
+
+// Sensor noise and stability over the sample window, in cl
+callback callback_window(CoapPacket &packet, IPAddress ip, int port) {
+  Tank* tank = request_tank(packet, ip, port);
+  if (!tank) {
+    return NULL;
+  }
+
+  StaticJsonBuffer<120> jsonBuffer;
 
   JsonObject& root = jsonBuffer.createObject();
-  root[String("volume")] = volume_sensor.state();
-  root[String("filling")] = filling.state();
-  root[String("filling_target")] = fill_target;
-  root[String("transferring")] = transferring.state();
-  root[String("transferring_amount")] = tx_amount;
+  root[F("n")] = tank->window.count();
+  root[F("mean")] = (int)round(tank->window.mean());
+  root[F("sd")] = (int)round(sqrt(tank->window.variance()));
+  root[F("min")] = tank->window.minimum();
+  root[F("max")] = tank->window.maximum();
 
-  String answer_json;
-  root.printTo(answer_json);
+  char answer_json[64];
+  size_t len = root.printTo(answer_json, sizeof(answer_json));
 
-  coap.sendResponse(ip, port, packet.messageid, (char*)answer_json.c_str(), answer_json.length(), COAP_CONTENT, COAP_APPLICATION_JSON ,NULL, 0);
+  coap.sendResponse(ip, port, packet.messageid, answer_json, len, COAP_CONTENT, COAP_APPLICATION_JSON, NULL, 0);
+  return NULL;
+}
+
+#ifdef USE_SAMPLE_CLOCK
+// Sampling cadence since the previous query
+callback callback_clock(CoapPacket &packet, IPAddress ip, int port) {
+  sample_clock_report_t r;
+  sample_clock.report(r);
+
+  StaticJsonBuffer<150> jsonBuffer;
+
+  JsonObject& root = jsonBuffer.createObject();
+  root[F("period_us")] = r.period_us;
+  root[F("jitter_us")] = r.jitter_us;
+  root[F("latency_us")] = r.latency_us;
+  root[F("missed")] = r.missed;
+  root[F("ticks")] = r.ticks;
+
+  char answer_json[80];
+  size_t len = root.printTo(answer_json, sizeof(answer_json));
+
+  coap.sendResponse(ip, port, packet.messageid, answer_json, len, COAP_CONTENT, COAP_APPLICATION_JSON, NULL, 0);
+  return NULL;
+}
+#endif
+
+#ifdef USE_IDLE_SLEEP
+// Awake share of the time since the previous query
+callback callback_idle(CoapPacket &packet, IPAddress ip, int port) {
+  idle_report_t r;
+  idle.report(r);
+
+  StaticJsonBuffer<140> jsonBuffer;
+
+  JsonObject& root = jsonBuffer.createObject();
+  root[F("duty_pm")] = r.duty_permille;
+  root[F("sleeps")] = r.sleeps;
+  root[F("longest_us")] = r.longest_us;
+  root[F("window_ms")] = r.window_ms;
+
+  char answer_json[80];
+  size_t len = root.printTo(answer_json, sizeof(answer_json));
+
+  coap.sendResponse(ip, port, packet.messageid, answer_json, len, COAP_CONTENT, COAP_APPLICATION_JSON, NULL, 0);
+  return NULL;
+}
+#endif
+
+// Per task [peak us, overruns, yields], loop [peak us, iterations]
+// and I2C transactions [done, errors, timeouts, rejected]. Peaks are
+// since the previous query, counters since boot. Streamed into the
+// packet, the document grows with the task count and the counters.
+callback callback_tasks(CoapPacket &packet, IPAddress ip, int port) {
+  StaticJsonBuffer<JSON_OBJECT_SIZE(SCHEDULER_MAX_TASKS + 2) + JSON_ARRAY_SIZE(2) + JSON_ARRAY_SIZE(4)
+    + SCHEDULER_MAX_TASKS * JSON_ARRAY_SIZE(3) + sizeof("loop") + sizeof("twi")> jsonBuffer;
+
+  JsonObject& root = jsonBuffer.createObject();
+  JsonArray& loop_stats = root.createNestedArray(F("loop"));
+  loop_stats.add(scheduler.loop_peak());
+  loop_stats.add(scheduler.loops());
+  const twi_stats_t& bus = twi.stats();
+  JsonArray& twi_stats = root.createNestedArray(F("twi"));
+  twi_stats.add(bus.done);
+  twi_stats.add(bus.errors);
+  twi_stats.add(bus.timeouts);
+  twi_stats.add(bus.rejected);
+  for (uint8_t i = 0; i < scheduler.count(); i++) {
+    const task_t& t = scheduler.task(i);
+    JsonArray& stats = root.createNestedArray(t.name);
+    stats.add(scheduler.peak(i, PEAK_TASKS));
+    stats.add(t.overruns);
+    stats.add(t.yields);
+  }
+
+  CoapResponse response(Udp);
+  response.begin(packet, ip, port, COAP_CONTENT)
+    .option(COAP_CONTENT_FORMAT, (uint32_t)COAP_APPLICATION_JSON);
+  root.printTo(response.body());
+  response.send();
+  return NULL;
+}
+
+// Ingress queue counters since boot
+callback callback_ingress(CoapPacket &packet, IPAddress ip, int port) {
+  const coap_ingress_stats_t& c = ingress.stats();
+
+  StaticJsonBuffer<170> jsonBuffer;
+
+  JsonObject& root = jsonBuffer.createObject();
+  root[F("queued")] = c.queued;
+  root[F("dropped")] = c.dropped;
+  root[F("rejected")] = c.rejected;
+  root[F("served")] = c.served;
+  root[F("depth")] = ingress.pending();
+  root[F("peak")] = c.peak;
+
+  char answer_json[100];
+  size_t len = root.printTo(answer_json, sizeof(answer_json));
+
+  coap.sendResponse(ip, port, packet.messageid, answer_json, len, COAP_CONTENT, COAP_APPLICATION_JSON, NULL, 0);
+  return NULL;
+}
+
+// Sends a response without payload and remembers it for retransmissions
+void respond(CoapPacket &packet, IPAddress ip, int port, COAP_RESPONSE_CODE code) {
+  dedup.store(ip, port, packet.messageid, code);
+  coap.sendResponse(ip, port, packet.messageid, NULL, 0, code, COAP_APPLICATION_JSON, NULL, 0);
+}
+
+// Answers a retransmitted request with the response it already got
+bool replayed(CoapPacket &packet, IPAddress ip, int port) {
+  uint8_t code;
+  if (!dedup.lookup(ip, port, packet.messageid, code)) {
+    return false;
+  }
+  coap.sendResponse(ip, port, packet.messageid, NULL, 0, (COAP_RESPONSE_CODE)code, COAP_APPLICATION_JSON, NULL, 0);
+  return true;
 }
 
 // CoAP server endpoint URL
 callback callback_fill(CoapPacket &packet, IPAddress ip, int port) {
+  if (replayed(packet, ip, port)) {
+    return NULL;
+  }
+  Tank* tank = request_tank(packet, ip, port);
+  if (!tank) {
+    return NULL;
+  }
 
   char p[packet.payloadlen + 1];
   memcpy(p, packet.payload, packet.payloadlen);
@@ -99,19 +540,23 @@ callback callback_fill(CoapPacket &packet, IPAddress ip, int port) {
   String message(p);
 
   int fill_to = message.toInt();
-  if (fill_to > 0 and fill_to < max_volume) {
-    fill_target = fill_to;
-    filling.on();
-    coap.sendResponse(ip, port, packet.messageid, NULL, 0, COAP_VALID, COAP_APPLICATION_JSON, NULL, 0);
+  if (tank->fill(fill_to)) {
+    respond(packet, ip, port, COAP_VALID);
   } else {
-    fill_target = 0;
-    filling.off();
-    coap.sendResponse(ip, port, packet.messageid, NULL, 0, COAP_NOT_ACCEPTABLE, COAP_APPLICATION_JSON, NULL, 0);
+    respond(packet, ip, port, COAP_NOT_ACCEPTABLE);
   }
+  return NULL;
 }
 
 
 callback callback_transfer(CoapPacket &packet, IPAddress ip, int port) {
+  if (replayed(packet, ip, port)) {
+    return NULL;
+  }
+  Tank* tank = request_tank(packet, ip, port);
+  if (!tank) {
+    return NULL;
+  }
 
   char p[packet.payloadlen + 1];
   memcpy(p, packet.payload, packet.payloadlen);
@@ -120,16 +565,474 @@ callback callback_transfer(CoapPacket &packet, IPAddress ip, int port) {
   String message(p);
 
   int transfer_amount = message.toInt();
-  if (transfer_amount > 0 and transfer_amount < volume_sensor.state()) {
-    tx_amount = transfer_amount;
-    transferring.on();
-    coap.sendResponse(ip, port, packet.messageid, NULL, 0, COAP_VALID, COAP_APPLICATION_JSON, NULL, 0);
+  if (tank->transfer(transfer_amount)) {
+    respond(packet, ip, port, COAP_VALID);
   } else {
-    tx_amount = transfer_amount;
-    transferring.off();
-    coap.sendResponse(ip, port, packet.messageid, NULL, 0, COAP_NOT_ACCEPTABLE, COAP_APPLICATION_JSON, NULL, 0);
+    respond(packet, ip, port, COAP_NOT_ACCEPTABLE);
+  }
+  return NULL;
+}
+
+// Operations of a /batch request, at most BATCH_MAX_OPS
+#define BATCH_MAX_OPS 8
+
+enum { BATCH_TARGET, BATCH_FILL, BATCH_FILL_STOP, BATCH_TRANSFER, BATCH_TRANSFER_STOP, BATCH_QUERY };
+
+struct batch_op_t {
+  uint8_t verb;
+  int value;  // dL, cl or index in batch_fields
+};
+
+// Fields a batch can query, named as in /status. Like every JSON key
+// here they stay in flash, and ArduinoJson copies the ones it writes
+// into the buffer, which is sized for them.
+enum { FIELD_VOLUME, FIELD_FLOW, FIELD_FILLING, FIELD_FILL_TARGET, FIELD_TRANSFERRING, FIELD_TX_AMOUNT, FIELD_COUNT };
+const char batch_fields[FIELD_COUNT][20] PROGMEM = { "volume", "flow", "filling", "filling_target", "transferring", "transferring_amount" };
+
+// Splits p into ops, returns how many or -1 if one is malformed
+int8_t batch_parse(char* p, batch_op_t* ops) {
+  uint8_t n = 0;
+  for (char* token = strtok(p, " ,"); token; token = strtok(NULL, " ,")) {
+    if (n == BATCH_MAX_OPS) {
+      return -1;
+    }
+    batch_op_t& op = ops[n++];
+    char* arg = token + 1;
+    switch (token[0]) {
+      case 'F':
+      case 'T': {
+        bool fill = token[0] == 'F';
+        if (strcmp(arg, "-") == 0) {
+          op.verb = fill ? BATCH_FILL_STOP : BATCH_TRANSFER_STOP;
+        } else if (fill && strcmp(arg, "+") == 0) {
+          op.verb = BATCH_FILL;
+        } else {
+          char* end;
+          long v = strtol(arg, &end, 10);
+          if (end == arg || *end || v < 0 || v > 32767) {
+            return -1;
+          }
+          op.verb = fill ? BATCH_TARGET : BATCH_TRANSFER;
+          op.value = v;
+        }
+        break;
+      }
+      case '?':
+        op.verb = BATCH_QUERY;
+        for (op.value = 0; op.value < FIELD_COUNT && strcmp_P(arg, batch_fields[op.value]); op.value++) {
+        }
+        if (op.value == FIELD_COUNT) {
+          return -1;
+        }
+        break;
+      default:
+        return -1;
+    }
+  }
+  return n;
+}
+
+// Index of the first operation the tank would refuse, -1 if none.
+// Checked in order against the state the previous ones leave, before
+// any is applied.
+int8_t batch_check(Tank& tank, const batch_op_t* ops, uint8_t n) {
+  int target = tank.control.fill_target;
+  for (uint8_t i = 0; i < n; i++) {
+    const batch_op_t& op = ops[i];
+    switch (op.verb) {
+      case BATCH_TARGET:
+        if (op.value >= tank.control.max_volume) return i;
+        target = op.value;
+        break;
+      case BATCH_FILL:
+        if (!tank.control.fill_valid(target)) return i;
+        break;
+      case BATCH_TRANSFER:
+        if (!tank.control.transfer_valid(op.value, tank.volume())) return i;
+        break;
+    }
+  }
+  return -1;
+}
+
+int batch_field(Tank& tank, uint8_t field) {
+  switch (field) {
+    case FIELD_VOLUME: return tank.volume();
+    case FIELD_FLOW: return tank.sensor.flow();
+    case FIELD_FILLING: return tank.filling.state();
+    case FIELD_FILL_TARGET: return tank.control.fill_target;
+    case FIELD_TRANSFERRING: return tank.transferring.state();
+    default: return tank.control.tx_amount;
+  }
+}
+
+// Several operations in one request, separated by spaces or commas:
+//   F<dL>  set the fill target     F+  start filling   F-  stop filling
+//   T<cl>  transfer that amount    T-  stop transferring
+//   ?<field>  a /status field, after the operations before it
+// e.g. "F900 F+ ?filling ?volume". All are applied in the same loop(),
+// or none: 4.06 with the index of the first refused. 2.04 carries the
+// queried fields. A retransmission only gets the code back.
+callback callback_batch(CoapPacket &packet, IPAddress ip, int port) {
+  if (replayed(packet, ip, port)) {
+    return NULL;
+  }
+  Tank* tank = request_tank(packet, ip, port);
+  if (!tank) {
+    return NULL;
+  }
+
+  char p[packet.payloadlen + 1];
+  memcpy(p, packet.payload, packet.payloadlen);
+  p[packet.payloadlen] = NULL;
+
+  batch_op_t ops[BATCH_MAX_OPS];
+  int8_t n = batch_parse(p, ops);
+  if (n <= 0) {
+    respond(packet, ip, port, COAP_BAD_REQUEST);
+    return NULL;
+  }
+
+  StaticJsonBuffer<220> jsonBuffer;
+  JsonObject& root = jsonBuffer.createObject();
+  COAP_RESPONSE_CODE code = COAP_CHANGED;
+
+  int8_t refused = batch_check(*tank, ops, n);
+  if (refused >= 0) {
+    code = COAP_NOT_ACCEPTABLE;
+    root[F("refused")] = refused;
+  } else {
+    for (uint8_t i = 0; i < n; i++) {
+      const batch_op_t& op = ops[i];
+      switch (op.verb) {
+        case BATCH_TARGET: tank->control.fill_target = op.value; break;
+        case BATCH_FILL: tank->fill(tank->control.fill_target); break;
+        case BATCH_FILL_STOP: tank->stop_filling(); break;
+        case BATCH_TRANSFER: tank->transfer(op.value); break;
+        case BATCH_TRANSFER_STOP: tank->stop_transferring(); break;
+        case BATCH_QUERY: root[(const __FlashStringHelper*)batch_fields[op.value]] = batch_field(*tank, op.value); break;
+      }
+    }
+  }
+
+  char answer_json[140];
+  size_t len = root.printTo(answer_json, sizeof(answer_json));
+
+  dedup.store(ip, port, packet.messageid, code);
+  coap.sendResponse(ip, port, packet.messageid, answer_json, len, code, COAP_APPLICATION_JSON, NULL, 0);
+  return NULL;
+}
+
+// Copies root[key] to v when present. False when it is not an integer
+// or out of [low, high], the range of v, so that nothing wraps.
+template <typename T>
+bool config_field(JsonObject& root, const __FlashStringHelper* key, long low, long high, T& v) {
+  if (!root.containsKey(key)) {
+    return true;
+  }
+  if (!root[key].is<long>()) {
+    return false;
+  }
+  long raw = root[key].as<long>();
+  if (raw < low || raw > high) {
+    return false;
+  }
+  v = raw;
+  return true;
+}
+
+// Copies the fields present in root over c, tank n. False if one does
+// not fit its field.
+bool config_merge(JsonObject& root, hlt_config_t& c, uint8_t n) {
+  tank_config_t& t = c.tank[n];
+  return config_field(root, F("fs_mv"), 0, 65535L, t.calibration.full_scale_mv)
+    && config_field(root, F("zero_mv"), 0, 65535L, t.calibration.zero_mv)
+    && config_field(root, F("span_mv"), 0, 65535L, t.calibration.span_mv)
+    && config_field(root, F("span_pa"), 0, 65535L, t.calibration.span_pascal)
+    && config_field(root, F("radius_mm"), 0, 65535L, t.calibration.tank_radius_mm)
+    && config_field(root, F("offset"), -32768L, 32767, t.calibration.volume_offset)
+    && config_field(root, F("max_volume"), -32768L, 32767, t.max_volume)
+    && config_field(root, F("oversample"), 0, 255, c.oversample);
+}
+
+// GET the settings, PUT/POST a JSON object with the ones to change.
+// Datagrams are limited to COAP_INGRESS_MTU bytes, send a few fields at
+// a time. Calibration and max_volume are per tank, oversample is
+// shared.
+callback callback_config(CoapPacket &packet, IPAddress ip, int port) {
+  if (packet.code != COAP_GET && replayed(packet, ip, port)) {
+    return NULL;
+  }
+  Tank* tank = request_tank(packet, ip, port);
+  if (!tank) {
+    return NULL;
+  }
+  uint8_t n = ingress.index();
+
+  if (packet.code != COAP_GET) {
+
+    char p[packet.payloadlen + 1];
+    memcpy(p, packet.payload, packet.payloadlen);
+    p[packet.payloadlen] = NULL;
+
+    StaticJsonBuffer<150> jsonBuffer;
+    JsonObject& root = jsonBuffer.parseObject(p);
+
+    hlt_config_t c = config;
+    if (!root.success() || !config_merge(root, c, n) || !config_valid(c)) {
+      respond(packet, ip, port, COAP_BAD_REQUEST);
+      return NULL;
+    }
+
+    if (c.tank[n].calibration.zero_mv != config.tank[n].calibration.zero_mv) {
+      tank->sensor.trim(0, ZERO_CALIBRATED); // a new zero replaces the learned one
+    }
+    tank->configure(c.tank[n]);
+    if (c.oversample != config.oversample) {
+      for (uint8_t i = 0; i < TANK_COUNT; i++) {
+        tanks[i].sensor.oversample(c.oversample);
+      }
+    }
+    config = c;
+    config_store.save(config, CONFIG_VERSION);
+    respond(packet, ip, port, COAP_CHANGED);
+    return NULL;
+  }
+
+  StaticJsonBuffer<280> jsonBuffer;
+
+  JsonObject& root = jsonBuffer.createObject();
+  const tank_config_t& t = config.tank[n];
+  root[F("fs_mv")] = t.calibration.full_scale_mv;
+  root[F("zero_mv")] = t.calibration.zero_mv;
+  root[F("span_mv")] = t.calibration.span_mv;
+  root[F("span_pa")] = t.calibration.span_pascal;
+  root[F("radius_mm")] = t.calibration.tank_radius_mm;
+  root[F("offset")] = t.calibration.volume_offset;
+  root[F("max_volume")] = t.max_volume;
+  root[F("oversample")] = config.oversample;
+  // PGA range in use, follows the signal when fs_mv is 0
+  root[F("pga_mv")] = tank->sensor.full_scale();
+
+  char answer_json[150];
+  size_t len = root.printTo(answer_json, sizeof(answer_json));
+
+  coap.sendResponse(ip, port, packet.messageid, answer_json, len, COAP_CONTENT, COAP_APPLICATION_JSON, NULL, 0);
+  return NULL;
+}
+
+// Measured delay between each relay edge and the volume answering it,
+// per edge [median ms, last ms, measured, missed]
+callback callback_deadtime(CoapPacket &packet, IPAddress ip, int port) {
+  Tank* tank = request_tank(packet, ip, port);
+  if (!tank) {
+    return NULL;
+  }
+  static const char edges[DEADTIME_EDGES][8] PROGMEM = { "in_on", "in_off", "out_on", "out_off" };
+
+  StaticJsonBuffer<230> jsonBuffer;
+
+  JsonObject& root = jsonBuffer.createObject();
+  for (uint8_t i = 0; i < DEADTIME_EDGES; i++) {
+    deadtime_report_t r;
+    tank->dead_time.report(i, r);
+    JsonArray& edge = root.createNestedArray((const __FlashStringHelper*)edges[i]);
+    edge.add(r.median_ms);
+    edge.add(r.last_ms);
+    edge.add(r.measured);
+    edge.add(r.missed);
+  }
+
+  char answer_json[150];
+  size_t len = root.printTo(answer_json, sizeof(answer_json));
+
+  coap.sendResponse(ip, port, packet.messageid, answer_json, len, COAP_CONTENT, COAP_APPLICATION_JSON, NULL, 0);
+  return NULL;
+}
+
+// GET the zero trim of the sensor, in 7.8125 uV codes. PUT/POST {}
+// with the tank empty re-zeros from the current samples, {"ref":true}
+// against the reference on AIN3 at any level (done after the next
+// sample), {"trim":codes} sets it. DELETE goes back to the calibrated
+// zero. The tank also re-zeros itself when a transfer drained it.
+callback callback_zero(CoapPacket &packet, IPAddress ip, int port) {
+  static const char sources[][11] PROGMEM = { "calibrated", "empty", "command", "reference", "restored" };
+
+  if (packet.code != COAP_GET && replayed(packet, ip, port)) {
+    return NULL;
+  }
+  Tank* tank = request_tank(packet, ip, port);
+  if (!tank) {
+    return NULL;
+  }
+
+  if (packet.code == COAP_DELETE) {
+    tank->sensor.trim(0, ZERO_CALIBRATED);
+    respond(packet, ip, port, COAP_DELETED);
+    return NULL;
+  }
+
+  if (packet.code != COAP_GET) {
+
+    char p[packet.payloadlen + 1];
+    memcpy(p, packet.payload, packet.payloadlen);
+    p[packet.payloadlen] = NULL;
+
+    StaticJsonBuffer<60> jsonBuffer;
+    JsonObject& root = packet.payloadlen > 0 ? jsonBuffer.parseObject(p) : jsonBuffer.createObject();
+    if (!root.success()) {
+      respond(packet, ip, port, COAP_BAD_REQUEST);
+      return NULL;
+    }
+
+    bool ok;
+    if (root.containsKey(F("trim"))) {
+      ok = tank->sensor.trim(root[F("trim")].as<int>(), ZERO_COMMAND);
+    } else if (root[F("ref")].as<bool>()) {
+      ok = tank->sensor.reference();
+    } else {
+      ok = tank->zero(ZERO_COMMAND);
+    }
+    respond(packet, ip, port, ok ? COAP_CHANGED : COAP_NOT_ACCEPTABLE);
+    return NULL;
+  }
+
+  StaticJsonBuffer<140> jsonBuffer;
+
+  JsonObject& root = jsonBuffer.createObject();
+  root[F("trim")] = tank->sensor.zero_trim();
+  root[F("trim_uv")] = (long)tank->sensor.zero_trim() * 78125 / 10000;
+  root[F("source")] = (const __FlashStringHelper*)sources[tank->sensor.zero_source()];
+  root[F("pending")] = tank->sensor.referencing();
+
+  char answer_json[80];
+  size_t len = root.printTo(answer_json, sizeof(answer_json));
+
+  coap.sendResponse(ip, port, packet.messageid, answer_json, len, COAP_CONTENT, COAP_APPLICATION_JSON, NULL, 0);
+  return NULL;
+}
+
+#ifdef USE_SENML_PUSH
+// GET the collector and the push counters since boot, PUT/POST a JSON
+// object with the settings to change, e.g. {"ip":"192.168.1.10"}.
+// An ip of 0.0.0.0 stops pushing. port is 1 to 65535, interval 1 to
+// PUSH_INTERVAL_MAX s and period 100 to PUSH_PERIOD_MAX ms, 4.00
+// otherwise.
+callback callback_push(CoapPacket &packet, IPAddress ip, int port) {
+  if (packet.code != COAP_GET) {
+    if (replayed(packet, ip, port)) {
+      return NULL;
+    }
+
+    char p[packet.payloadlen + 1];
+    memcpy(p, packet.payload, packet.payloadlen);
+    p[packet.payloadlen] = NULL;
+
+    StaticJsonBuffer<100> jsonBuffer;
+    JsonObject& root = jsonBuffer.parseObject(p);
+
+    push_config_t c = push_config;
+    bool ok = root.success();
+    if (ok && root.containsKey(F("ip"))) {
+      IPAddress collector;
+      const char* address = root[F("ip")];
+      ok = address && collector.fromString(address);
+      for (uint8_t i = 0; i < 4; i++) {
+        c.ip[i] = collector[i];
+      }
+    }
+    ok = ok
+      && config_field(root, F("port"), 1, 65535L, c.port)
+      && config_field(root, F("interval"), 1, PUSH_INTERVAL_MAX, c.interval_s)
+      && config_field(root, F("period"), 100, PUSH_PERIOD_MAX, c.period_ms);
+    if (!ok || !push_valid(c)) {
+      respond(packet, ip, port, COAP_BAD_REQUEST);
+      return NULL;
+    }
+
+    push_config = c;
+    push_apply(push_config);
+    push_store.save(push_config, PUSH_CONFIG_VERSION);
+    respond(packet, ip, port, COAP_CHANGED);
+    return NULL;
+  }
+
+  const senml_stats_t& s = push.stats();
+  char collector[16];
+  sprintf(collector, "%u.%u.%u.%u", push_config.ip[0], push_config.ip[1], push_config.ip[2], push_config.ip[3]);
+
+  StaticJsonBuffer<210> jsonBuffer;
+
+  JsonObject& root = jsonBuffer.createObject();
+  root[F("ip")] = collector;
+  root[F("port")] = push_config.port;
+  root[F("interval")] = push_config.interval_s;
+  root[F("period")] = push_config.period_ms;
+  root[F("batches")] = s.batches;
+  root[F("samples")] = s.samples;
+  root[F("dropped")] = s.dropped;
+  root[F("errors")] = s.errors;
+
+  char answer_json[130];
+  size_t len = root.printTo(answer_json, sizeof(answer_json));
+
+  coap.sendResponse(ip, port, packet.messageid, answer_json, len, COAP_CONTENT, COAP_APPLICATION_JSON, NULL, 0);
+  return NULL;
+}
+#endif
+
+#ifdef USE_SRAM_MONITOR
+// Stack measured per CoAP resource, slots in /sram order
+enum { PROBE_STATUS, PROBE_FILL, PROBE_TRANSFER, PROBE_TASKS, PROBE_INGRESS, PROBE_CLOCK, PROBE_SRAM, PROBE_CONFIG, PROBE_IDLE, PROBE_PUSH, PROBE_DEADTIME, PROBE_ZERO, PROBE_BATCH, PROBE_WINDOW, PROBE_COUNT };
+const char probe_names[PROBE_COUNT][9] PROGMEM = { "status", "fill", "transfer", "tasks", "ingress", "clock", "sram", "config", "idle", "push", "deadtime", "zero", "batch", "window" };
+
+static_assert(PROBE_COUNT <= SRAM_PROBE_SLOTS, "raise SRAM_PROBE_SLOTS");
+
+typedef callback (*handler_t)(CoapPacket &packet, IPAddress ip, int port);
+
+// Runs a resource handler between stack probes
+template <handler_t handler, uint8_t slot>
+void probed(CoapPacket &packet, IPAddress ip, int port) {
+  sram.probe_begin();
+  handler(packet, ip, port);
+  sram.probe_end(slot);
+}
+
+#define COAP_HANDLER(handler, slot) probed<handler, slot>
+
+// Static size, stack peak, never used bytes, heap [used, free list,
+// fragments, largest block] and peak stack per resource, in bytes
+callback callback_sram(CoapPacket &packet, IPAddress ip, int port) {
+  sram_heap_t h;
+  sram.heap(h);
+
+  StaticJsonBuffer<450> jsonBuffer;
+
+  JsonObject& root = jsonBuffer.createObject();
+  root[F("static")] = sram.static_size();
+  root[F("stack")] = sram.stack_peak();
+  root[F("unused")] = sram.unused();
+
+  JsonArray& heap = root.createNestedArray(F("heap"));
+  heap.add(h.used);
+  heap.add(h.free_list);
+  heap.add(h.fragments);
+  heap.add(h.largest);
+
+  JsonObject& callbacks = root.createNestedObject(F("callbacks"));
+  for (uint8_t i = 0; i < PROBE_COUNT; i++) {
+    callbacks[(const __FlashStringHelper*)probe_names[i]] = sram.probe_peak(i);
   }
+
+  char answer_json[280];
+  size_t len = root.printTo(answer_json, sizeof(answer_json));
+
+  coap.sendResponse(ip, port, packet.messageid, answer_json, len, COAP_CONTENT, COAP_APPLICATION_JSON, NULL, 0);
+  return NULL;
 }
+#else
+#define COAP_HANDLER(handler, slot) handler
+#endif
 
 #endif
 
@@ -137,6 +1040,11 @@ callback callback_transfer(CoapPacket &packet, IPAddress ip, int port) {
 // Display
 U8X8_SSD1306_128X32_UNIVISION_4W_SW_SPI u8x8(OLED_CLK_PIN, OLED_MOSI_PIN, OLED_CS_PIN, OLED_DC_PIN, OLED_RST_PIN);
 
+// Idle screens only send the 8x8 tiles that changed
+TileText<U8X8, 16, 4> screen(u8x8);
+bool display_dirty = false;
+uint32_t display_last_frame = 0;
+
 Menu::panel panels[] MEMMODE={{0,0,40,2}};
 Menu::navNode* nodes[sizeof(panels)/sizeof(Menu::panel)];//navNodes to store navigation status
 Menu::panelsList pList(panels, nodes, 1);//a list of panels and nodes
@@ -154,13 +1062,13 @@ void doFillTank(eventMask);
 void doDrawError(eventMask);
 
 MENU(fillMenu, "REMPLIR...", doNothing, noEvent, wrapStyle,
-  FIELD(fill_target, "JUSQU'A: ", "L", 0, 900, 100, 10, doNothing, noEvent, noStyle),
+  FIELD(tanks[0].control.fill_target, "JUSQU'A: ", "L", 0, 900, 100, 10, doNothing, noEvent, noStyle),
   OP("GO!", doFillTank, enterEvent),
   EXIT("ANNULER")
 );
 
 MENU(txMenu, "TRANSFERER...", doNothing, noEvent, wrapStyle,
-  FIELD(tx_amount, "QUANTITE: ", "L", 0, 900, 10, 1, doNothing, noEvent, noStyle),
+  FIELD(tanks[0].control.tx_amount, "QUANTITE: ", "L", 0, 900, 10, 1, doNothing, noEvent, noStyle),
   OP("GO!", doNothing, enterEvent),
   EXIT("ANNULER")
 );
@@ -173,36 +1081,96 @@ MENU(mainMenu, "HLT", doNothing, noEvent, wrapStyle,
 
 NAVROOT(nav, mainMenu, MAX_DEPTH, in, out); //the navigation root object
 
+// Encoder and button, captured by pin_events in this watch() order
+enum { INPUT_ENCODER_A, INPUT_ENCODER_B, INPUT_BUTTON };
+
+#define BUTTON_DEBOUNCE 100    // ms
+#define BUTTON_LONG_PRESS 1000 // ms
+
+Quadrature encoder(10);
+Debounce button(BUTTON_DEBOUNCE);
+bool button_long = false;
+
+// Menu navigation from the captured edges: every encoder step, a short
+// press (on release) enters, a long press (once held) escapes. The
+// button is debounced on the edge timestamps, not on when this runs.
+void read_inputs() {
+  pin_event_t e;
+  while (pin_events.pop(e)) {
+    int8_t step = encoder.update(e.pins & _BV(INPUT_ENCODER_A), e.pins & _BV(INPUT_ENCODER_B));
+    if (step != 0) {
+      nav.doNav(navCmd(step > 0 ? upCmd : downCmd));
+    }
+    button.sample(!(e.pins & _BV(INPUT_BUTTON)), e.timestamp); // pressed pulls low
+  }
+
+  uint16_t now = millis();
+  if (button.update(now) && !button.level()) {
+    if (!button_long) {
+      nav.doNav(navCmd(enterCmd));
+    }
+    button_long = false;
+  } else if (button.level() && !button_long && (uint16_t)(now - button.since()) >= BUTTON_LONG_PRESS) {
+    button_long = true;
+    nav.doNav(navCmd(escCmd));
+  }
+}
+
 // Notify we need to update display
 void request_update_display(int idx, int v, int up) {
-  nav.idleChanged = true;
+  display_dirty = true;
+}
+
+// Turns sensor changes into idle screen refreshes, at most one per DISPLAY_FRAME_INTERVAL
+void pace_display() {
+  if (display_dirty && millis() - display_last_frame >= DISPLAY_FRAME_INTERVAL) {
+    display_last_frame = millis();
+    display_dirty = false;
+    nav.idleChanged = true;
+  }
 }
 
 result draw_filling(menuOut& o, idleEvent event) {
   char line1[32]; //, line2[20];
 
-  sprintf(line1, "  %d/%dL", (int)(volume_sensor.state()/10.0), fill_target);
-  u8x8.drawString(0, 0, "REMPLISSAGE...");
-  u8x8.drawString(0, 3, line1);
+  if (event == idleEnd) {
+    return proceed;
+  }
+  if (event == idleStart) {
+    screen.invalidate();
+  }
+
+  sprintf(line1, "  %d/%dL", (int)(tanks[0].volume()/10.0), tanks[0].control.fill_target);
+  screen.begin_frame();
+  screen.row(0, "REMPLISSAGE...");
+  screen.row(3, line1);
+  screen.end_frame();
 
   return proceed;
 }
 
 result draw_error(menuOut& o, idleEvent event) {
-  u8x8.clear();
-  u8x8.drawString(0, 1, "ERREUR:");
+  if (event == idleEnd) {
+    return proceed;
+  }
+  if (event == idleStart) {
+    screen.invalidate();
+  }
+
+  screen.begin_frame();
+  screen.row(1, "ERREUR:");
+  screen.end_frame();
 
   return proceed;
 }
 
+// The display drives the first tank
 void doFillTank(eventMask e) {
-  filling.off();
-
-  if (fill_target > max_volume) {
-    nav.idleOn(draw_error);
-  } else {
-    filling.on();
+  Tank& tank = tanks[0];
+  if (tank.fill(tank.control.fill_target)) {
     nav.idleOn(draw_filling);
+  } else {
+    nav.idleOn(draw_error);
   }
 }
 
@@ -213,31 +1181,156 @@ result draw_volume_big(menuOut& o, idleEvent event) {
   //float water_height = pressure / 10 / 9.80665; // column heigh
   //float volume = water_height * PI * (60*60); // H * PI * r^2
 
-  int volume = volume_sensor.state();
-
-  if (volume < 0) {
-    u8x8.drawString(0, 0, "Erreur de sonde");
+  if (event == idleEnd) {
     return proceed;
   }
+  if (event == idleStart) {
+    screen.invalidate();
+  }
 
-  //sprintf(line2, "Voltage: %s", String(voltage).c_str());
-  sprintf(line1, "V: %3d.%02dL", volume/10, volume%10);
+  int volume = tanks[0].volume();
 
-  u8x8.clear();
-  u8x8.drawString(0, 0, line1);
-  //u8x8.drawString(0, 1, line2);
-  //u8x8.refreshDisplay();
+  screen.begin_frame();
+  if (volume < 0) {
+    screen.row(0, "Erreur de sonde");
+  } else {
+    //sprintf(line2, "Voltage: %s", String(voltage).c_str());
+    sprintf(line1, "V: %3d.%02dL", volume/10, volume%10);
+    screen.row(0, line1);
+    //screen.row(1, line2);
+  }
+  screen.end_frame();
 
   return proceed;
 }
 
 #endif // USE_LCD
 
+// Sensor acquisition, controllers and relays
+void run_automaton() {
+  twi.poll(); // ADC reads finished since the last run
+  automaton.run();
+  for (uint8_t i = 0; i < TANK_COUNT; i++) {
+    tanks[i].poll();
+  }
+}
+
+#ifdef USE_COAP
+void run_coap() {
+  ingress.poll();
+  ingress.serve(COAP_REQUESTS_PER_LOOP);
+  coap.loop();
+#ifdef USE_IDLE_SLEEP
+  if (ingress.pending() > 0) {
+    idle.hold(); // more requests queued
+  }
+#endif
+}
+#endif
+
+#ifdef USE_SENML_PUSH
+uint32_t push_last_sample = 0;
+
+// A sample of every tank each period_ms, the batch goes out in pieces
+void run_push() {
+  if (push.enabled() && millis() - push_last_sample >= push_config.period_ms) {
+    push_last_sample = millis();
+    for (uint8_t i = 0; i < TANK_COUNT; i++) {
+      senml_sample_t s;
+      s.timestamp = push_last_sample;
+      s.tank = i;
+      s.filling = tanks[i].filling.state();
+      s.transferring = tanks[i].transferring.state();
+      s.volume = tanks[i].volume();
+      s.flow = tanks[i].sensor.flow();
+      push.record(s);
+    }
+  }
+  push.poll();
+}
+#endif
+
+#ifdef USE_LCD
+void run_display() {
+  read_inputs();
+  pace_display();
+  nav.doOutput();
+}
+#endif
+
+// Pending EEPROM writes, and a snapshot once per SNAPSHOT_INTERVAL if
+// the volume or the learned pump flows moved
+void run_persist() {
+  config_store.poll();
+  snapshot_store.poll();
+#ifdef USE_SENML_PUSH
+  push_store.poll();
+#endif
+  if (millis() - snapshot_last < SNAPSHOT_INTERVAL) {
+    return;
+  }
+  snapshot_last = millis();
+
+  snapshot_t s;
+  bool moved = false;
+  for (uint8_t i = 0; i < TANK_COUNT; i++) {
+    const estimator_state_t& saved = snapshot_saved.estimator[i];
+    tanks[i].estimator.save(s.estimator[i]);
+    s.zero_trim[i] = tanks[i].sensor.zero_trim();
+    moved = moved || s.zero_trim[i] != snapshot_saved.zero_trim[i] || abs(s.estimator[i].x - saved.x) > ((int32_t)SNAPSHOT_DEADBAND << 8)
+      || s.estimator[i].learned_in != saved.learned_in
+      || s.estimator[i].learned_out != saved.learned_out;
+  }
+  if (moved) {
+    snapshot_store.save(s, SNAPSHOT_VERSION);
+    snapshot_saved = s;
+  }
+}
+
+#ifdef USE_SRAM_MONITOR
+void run_sram() {
+  sram.scan();
+}
+#endif
+
+#ifdef USE_IDLE_SLEEP
+// Called with interrupts off before sleeping: a tick, an I2C read or
+// an input edge arrived since the tasks ran
+bool work_ready() {
+#ifdef USE_SAMPLE_CLOCK
+  if (sample_clock.due()) return true;
+#endif
+#ifdef USE_LCD
+  if (pin_events.pending() > 0) return true;
+#endif
+  return twi.ready();
+}
+#endif
+
+#ifdef USE_TELEMETRY
+void run_telemetry() {
+  if (telemetry.due()) {
+    send_telemetry();
+  }
+  telemetry.drain();
+}
+#endif
+
 void setup() {
   wdt_disable();
 
+#ifdef USE_SRAM_MONITOR
+  sram.begin();
+#endif
+
+#ifdef USE_TELEMETRY
+  // Binary telemetry, 250000 baud is exact with a 16MHz clock
+  Serial.begin(250000);
+  telemetry.begin(Serial, 10);
+#else
   // Start serial communication and set baud rate = 9600
   Serial.begin(9600);
+#endif
 
 #ifdef USE_LCD
   // OLED Display
@@ -249,77 +1342,101 @@ void setup() {
 #ifdef USE_COAP
   // Start the Ethernet connection and the server
   if (Ethernet.begin(mac) == 0) {
+#ifdef USE_TELEMETRY
+    dhcp_failed = true;
+#else
     Serial.println("Failed to configure Ethernet using DHCP");
+#endif
     // no point in carrying on, so do nothing forevermore:
     // try to congifure using IP address instead of DHCP:
     // Ethernet.begin(mac, ip);
   }
 
-  // CoAP callbacks
-  coap.server(callback_status, "status");
-  coap.server(callback_fill, "fill");
-  coap.server(callback_transfer, "transfer");
+  dedup.begin();
 
-  coap.start();
+  // ETags must not repeat across reboots, DHCP timing is random enough
+  for (uint8_t i = 0; i < TANK_COUNT; i++) {
+    status_version[i] = micros() + (i << 12);
+  }
 
-#endif // USE_COAP
+  // Requests for tank/<n>/... reach the handlers below with index() n
+  ingress.collection("tank");
 
-  // Sensor reading
-  volume_sensor.begin(10)
-    .average(avgbuffer, sizeof(avgbuffer))
-#ifdef USE_LCD
-    .onChange(request_update_display)
+  // CoAP callbacks
+  coap.server(COAP_HANDLER(callback_status, PROBE_STATUS), "status");
+  coap.server(COAP_HANDLER(callback_fill, PROBE_FILL), "fill");
+  coap.server(COAP_HANDLER(callback_transfer, PROBE_TRANSFER), "transfer");
+  coap.server(COAP_HANDLER(callback_tasks, PROBE_TASKS), "tasks");
+  coap.server(COAP_HANDLER(callback_ingress, PROBE_INGRESS), "ingress");
+#ifdef USE_SAMPLE_CLOCK
+  coap.server(COAP_HANDLER(callback_clock, PROBE_CLOCK), "clock");
+#endif
+#ifdef USE_SRAM_MONITOR
+  coap.server(COAP_HANDLER(callback_sram, PROBE_SRAM), "sram");
+#endif
+  coap.server(COAP_HANDLER(callback_config, PROBE_CONFIG), "config");
+#ifdef USE_IDLE_SLEEP
+  coap.server(COAP_HANDLER(callback_idle, PROBE_IDLE), "idle");
+#endif
+#ifdef USE_SENML_PUSH
+  coap.server(COAP_HANDLER(callback_push, PROBE_PUSH), "push");
 #endif
-    ;
-
-  // Flags
-  filling.begin()
-    .onChange(true, water_in_relay, water_in_relay.EVT_ON)
-    .onChange(true, transferring, transferring.EVT_OFF)
-    .onChange(false, water_in_relay, water_in_relay.EVT_OFF)
-    .off();
 
-  transferring.begin()
-    .onChange(true, water_out_relay, water_out_relay.EVT_ON)
-    .onChange(true, filling, filling.EVT_OFF)
-    .onChange(false, water_out_relay, water_out_relay.EVT_OFF)
-    .off();
+  // Past the 10 resources Coap holds
+  ingress.server(COAP_HANDLER(callback_deadtime, PROBE_DEADTIME), "deadtime");
+  ingress.server(COAP_HANDLER(callback_zero, PROBE_ZERO), "zero");
+  ingress.server(COAP_HANDLER(callback_batch, PROBE_BATCH), "batch");
+  ingress.server(COAP_HANDLER(callback_window, PROBE_WINDOW), "window");
 
-  // Controllers
-  filling_controller.begin()
-    .IF(volume_sensor, '+', (fill_target*10)) // fill target reached
-    .OR(volume_sensor, '+', max_volume) // tank is full
-    .onChange(true, filling, filling.EVT_OFF);
+  coap.start();
 
-  transferring_controller.begin()
-    .IF(volume_sensor, '<', 10) // empty tank
-    .onChange(true, transferring, transferring.EVT_OFF);
+#ifdef USE_SENML_PUSH
+  // Records are named after the MAC, RFC 8428 base name
+  sprintf(push_base_name, "urn:dev:mac:%02x%02x%02x%02x%02x%02x:", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+  push_udp.begin(SENML_LOCAL_PORT);
+  push.begin(push_base_name, micros());
+  if (!push_store.load(push_config, PUSH_CONFIG_VERSION) || !push_valid(push_config)) {
+    push_defaults(push_config);
+  }
+  push_apply(push_config);
+#endif
 
+#endif // USE_COAP
 
-  // Water in/out pump relay
-  water_in_relay.begin(WATER_IN_RELAY_PIN, false).off();
-  water_out_relay.begin(WATER_OUT_RELAY_PIN, true).off();
+  // Settings from EEPROM, defaults if none is valid
+  if (!config_store.load(config, CONFIG_VERSION) || !config_valid(config)) {
+    config_defaults(config);
+  }
 
+  // Sensors, flags, controllers and relays of every tank. The sensors
+  // share the ADC, each one samples 1 / TANK_COUNT of the time.
+  for (uint8_t i = 0; i < TANK_COUNT; i++) {
+    tanks[i].begin(i, tank_pins[i], config.tank[i], config.oversample);
+#ifdef USE_SAMPLE_CLOCK
+    tanks[i].sensor.clock(sample_clock);
+#endif
+  }
 #ifdef USE_LCD
-  // Trigger button
-  button.begin(BUTTON_PIN)
-    .debounce(100)
-    .onPress( [] (int idx, int v, int up) {
-      switch ( v ) {
-        case 1: // short press
-          nav.doNav(navCmd(enterCmd));
-          return;
-        case 2: // longpress
-          nav.doNav(navCmd(escCmd));
-          return;
-        }
-    })
-    .longPress(2, 1000);
+  tanks[0].sensor.onChange(request_update_display);
+#endif
 
-  rotary.begin(7, 6, 10)
-    .onChange( [] ( int idx, int v, int up ) {
-        nav.doNav(navCmd(up == 1 ? upCmd : downCmd));
-      });
+  // Warm start: resume the volumes saved before the reset
+  snapshot_t snapshot;
+  if (snapshot_store.load(snapshot, SNAPSHOT_VERSION)) {
+    for (uint8_t i = 0; i < TANK_COUNT; i++) {
+      tanks[i].sensor.warm(snapshot.estimator[i]);
+      if (snapshot.zero_trim[i] != 0) {
+        tanks[i].sensor.trim(snapshot.zero_trim[i], ZERO_RESTORED);
+      }
+    }
+    snapshot_saved = snapshot;
+  }
+
+#ifdef USE_LCD
+  // Encoder and trigger button edges, read by read_inputs()
+  pin_events.watch(ENCODER_A_PIN, INPUT)
+    .watch(ENCODER_B_PIN, INPUT)
+    .watch(BUTTON_PIN, INPUT_PULLUP);
 
 
   nav.idleTask = draw_volume_big;
@@ -327,6 +1444,32 @@ void setup() {
 
 #endif // USE_LCD
 
+  // Safety-critical work runs on every iteration, the rest yields
+  // once LOOP_BUDGET_US is spent
+  scheduler.begin(LOOP_BUDGET_US);
+  task_run = scheduler.add(run_automaton, "run", 1000, TASK_CRITICAL);
+#ifdef USE_COAP
+  task_coap = scheduler.add(run_coap, "coap", 1500, 1);
+#endif
+#ifdef USE_TELEMETRY
+  task_telemetry = scheduler.add(run_telemetry, "telemetry", 300, 2);
+#endif
+#ifdef USE_SENML_PUSH
+  scheduler.add(run_push, "push", 1500, 3);
+#endif
+#ifdef USE_LCD
+  task_display = scheduler.add(run_display, "display", 2000, 3);
+#endif
+#ifdef USE_SRAM_MONITOR
+  task_sram = scheduler.add(run_sram, "sram", 100, 4);
+#endif
+  scheduler.add(run_persist, "persist", 100, 4);
+
+#ifdef USE_IDLE_SLEEP
+  // Sleep between iterations, unless an interrupt already left work
+  idle.begin(work_ready);
+#endif
+
   //  Re-enable watchdog
   delay(1000L);
   wdt_enable(WDTO_4S);
@@ -334,17 +1477,17 @@ void setup() {
 
 
 void loop() {
-#ifdef USE_LCD
-  nav.doOutput();
-#endif // USE_LCD
-
-#ifdef USE_COAP
-  coap.loop();
-#endif // USE_COAP
-
-  // main logic
-  automaton.run();
+  scheduler.run();
 
   // Reset watchdog
   wdt_reset();
+
+#ifdef USE_IDLE_SLEEP
+  // Timer0 wakes the CPU every 1.024 ms at the latest, well within the
+  // watchdog timeout
+  if (scheduler.backlog()) {
+    idle.hold();
+  }
+  idle.sleep();
+#endif
 }
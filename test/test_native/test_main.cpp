@@ -0,0 +1,439 @@
+// The firmware of src/ on the host, as the native build runs it, with
+// an ADS1115 answering on the bus and two tanks of water behind it.
+// Requests go in through a UDP socket on 127.0.0.1, the way a client
+// on the network sends them, and Tank::poll() acts on the levels the
+// sensors read: the scan of the sensors, the TWI queue, the CoAP
+// handlers and the pump control run together as on the board, in real
+// time.
+//
+// TWI_vect() is called here with the status the TWI hardware would
+// set, after every loop() and from yield() while setup() delays.
+//
+//   pio test -e native
+
+#include <Arduino.h>
+#include <arpa/inet.h>
+#include <avr/eeprom.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <util/twi.h>
+#include <unity.h>
+#include <coap.h>
+
+#include "Tank.hpp"
+
+static_assert( TANK_COUNT == 2, "the tests scan two tanks, see platformio.ini" );
+
+// src/main.cpp
+extern Tank tanks[];
+extern "C" void TWI_vect( void );
+
+// Relay pins, as in main.cpp. water_out is active low.
+static const tank_pins_t pins[TANK_COUNT] = { { 2, 3 }, { A0, A1 } };
+
+#define ADS1115_ADDRESS 0x48
+#define ADS1115_POINTER_CONFIG 0x01
+
+// Flow of either pump, in cl/s
+#define PUMP_FLOW 100
+
+// Off the level by more than this, a volume is wrong. A sample period
+// of flow, the estimator's lag and a few codes of quantization.
+#define VOLUME_TOLERANCE 15  // cl
+
+// Tanks
+
+static float level[TANK_COUNT];  // cl
+static uint32_t plant_last;
+
+// Levels follow the relay pins since the previous call
+static void plant( void ) {
+  uint32_t now = millis();
+  float dt = ( now - plant_last ) / 1000.0f;
+  plant_last = now;
+  for ( uint8_t i = 0; i < TANK_COUNT; i++ ) {
+    if ( digitalRead( pins[i].water_in ) ) {
+      level[i] += PUMP_FLOW * dt;
+    }
+    if ( !digitalRead( pins[i].water_out ) ) {
+      level[i] = max( level[i] - PUMP_FLOW * dt, 0.0f );
+    }
+  }
+}
+
+// ADS1115
+
+static const uint16_t pga_mv[8] = { 6144, 4096, 2048, 1024, 512, 256, 256, 256 };
+
+static VolumeConversion model;  // default calibration, cl to codes
+static uint16_t ads_config;
+static uint16_t ads_configs;    // config writes seen
+
+// Conversion of the input and range of the config. The transmitter
+// output is taken from the calibration, through the firmware's own
+// conversion run backwards. Differential inputs read 0.
+static int16_t ads_conversion( void ) {
+  uint8_t mux = ( ads_config >> 12 ) & 0x07;
+  if ( mux < 4 ) {
+    return 0;
+  }
+  int zero = model.convert( 0, 0 );
+  float cl_per_code = ( model.convert( 1L << 20, 0 ) - zero ) / 1048576.0f;
+  float codes = ( level[mux - 4] - zero ) / cl_per_code;  // 7.8125 uV
+  long code = lround( codes * 256 / pga_mv[( ads_config >> 9 ) & 0x07] );
+  return constrain( code, -32768L, 32767L );
+}
+
+// Bus, as TwiQueue sees it through TWCR / TWSR / TWDR
+
+enum { BUS_IDLE, BUS_ADDRESS, BUS_WRITE, BUS_READ };
+
+static struct {
+  uint8_t phase;
+  uint8_t tx[TWI_MAX_TX];
+  uint8_t tx_len;
+  uint8_t rx[2];
+  uint8_t rx_pos;
+} bus;
+
+static bool bus_stalled;  // nothing answers, transactions time out
+
+// Register write of the transfer that ended
+static void ads_written( void ) {
+  if ( bus.tx_len == 3 && bus.tx[0] == ADS1115_POINTER_CONFIG ) {
+    ads_config = ( bus.tx[1] << 8 ) | bus.tx[2];
+    ads_configs++;
+  }
+  bus.tx_len = 0;
+}
+
+// Takes the bus steps TwiQueue asked for, each with a TWINT written,
+// until it waits for a new transaction
+static void twi_run( void ) {
+  while ( !bus_stalled && ( TWCR & _BV( TWINT ) ) ) {
+    uint8_t status;
+    if ( TWCR & _BV( TWSTO ) ) {
+      ads_written();
+      bus.phase = BUS_IDLE;
+      TWCR = _BV( TWEN );
+      continue;
+    }
+    if ( TWCR & _BV( TWSTA ) ) {
+      ads_written();
+      status = bus.phase == BUS_IDLE ? TW_START : TW_REP_START;
+      bus.phase = BUS_ADDRESS;
+    } else if ( bus.phase == BUS_ADDRESS ) {
+      bool read = TWDR & TW_READ;
+      if ( ( TWDR >> 1 ) != ADS1115_ADDRESS ) {
+        status = read ? TW_MR_SLA_NACK : TW_MT_SLA_NACK;
+      } else if ( read ) {
+        int16_t code = ads_conversion();
+        bus.rx[0] = code >> 8;
+        bus.rx[1] = code & 0xFF;
+        bus.rx_pos = 0;
+        bus.phase = BUS_READ;
+        status = TW_MR_SLA_ACK;
+      } else {
+        bus.phase = BUS_WRITE;
+        status = TW_MT_SLA_ACK;
+      }
+    } else if ( bus.phase == BUS_WRITE ) {
+      if ( bus.tx_len < TWI_MAX_TX ) {
+        bus.tx[bus.tx_len++] = TWDR;
+      }
+      status = TW_MT_DATA_ACK;
+    } else {
+      TWDR = bus.rx[bus.rx_pos++ & 1];
+      status = TWCR & _BV( TWEA ) ? TW_MR_DATA_ACK : TW_MR_DATA_NACK;
+    }
+    TWSR = status;
+    TWCR &= ~_BV( TWINT );
+    TWI_vect();
+  }
+}
+
+// Interrupts while setup() waits
+void yield( void ) {
+  twi_run();
+}
+
+// One pass of the firmware and what happens around it
+static void step( void ) {
+  loop();
+  twi_run();
+  plant();
+}
+
+static void run( uint32_t ms ) {
+  uint32_t since = millis();
+  while ( millis() - since < ms ) {
+    step();
+  }
+}
+
+// Runs until check() holds, false after timeout_ms
+static bool run_until( bool ( *check )( void ), uint32_t timeout_ms ) {
+  uint32_t since = millis();
+  while ( !check() ) {
+    if ( millis() - since > timeout_ms ) {
+      return false;
+    }
+    step();
+  }
+  return true;
+}
+
+// CoAP client
+
+static int client = -1;
+static uint16_t next_mid = 1;
+static uint8_t answer[128];
+static int answer_len;
+
+static void client_begin( void ) {
+  client = socket( AF_INET, SOCK_DGRAM, 0 );
+  fcntl( client, F_SETFL, O_NONBLOCK );
+}
+
+// Sends a confirmable request for tank/<n>/<resource> with message ID
+// mid, and runs the firmware until the answer to it arrives. Returns
+// its code, 0 if none came.
+static uint8_t request( uint8_t method, uint8_t n, const char* resource, const char* payload, uint16_t mid ) {
+  uint8_t d[64];
+  uint8_t len = 0;
+  d[len++] = 0x40;  // version 1, confirmable, no token
+  d[len++] = method;
+  d[len++] = mid >> 8;
+  d[len++] = mid & 0xFF;
+  d[len++] = ( COAP_URI_PATH << 4 ) | 4;
+  memcpy( d + len, "tank", 4 );
+  len += 4;
+  d[len++] = 1;
+  d[len++] = '0' + n;
+  d[len++] = strlen( resource );
+  memcpy( d + len, resource, strlen( resource ) );
+  len += strlen( resource );
+  if ( payload && *payload ) {
+    d[len++] = COAP_PAYLOAD_MARKER;
+    memcpy( d + len, payload, strlen( payload ) );
+    len += strlen( payload );
+  }
+
+  sockaddr_in server;
+  memset( &server, 0, sizeof( server ) );
+  server.sin_family = AF_INET;
+  server.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+  server.sin_port = htons( COAP_DEFAULT_PORT );
+  sendto( client, d, len, 0, (sockaddr*)&server, sizeof( server ) );
+
+  uint32_t since = millis();
+  while ( millis() - since < 2000 ) {
+    step();
+    answer_len = recv( client, answer, sizeof( answer ) - 1, 0 );
+    if ( answer_len >= COAP_HEADER_SIZE && ( ( answer[2] << 8 ) | answer[3] ) == mid ) {
+      answer[answer_len] = 0;
+      return answer[1];
+    }
+  }
+  answer_len = 0;
+  return 0;
+}
+
+static uint8_t request( uint8_t method, uint8_t n, const char* resource, const char* payload ) {
+  return request( method, n, resource, payload, next_mid++ );
+}
+
+// Payload of the last answer
+static const char* answer_payload( void ) {
+  for ( int i = COAP_HEADER_SIZE + ( answer[0] & 0x0F ); i < answer_len; i++ ) {
+    if ( answer[i] == COAP_PAYLOAD_MARKER ) {
+      return (const char*)answer + i + 1;
+    }
+  }
+  return "";
+}
+
+static bool pumps_off( void ) {
+  for ( uint8_t i = 0; i < TANK_COUNT; i++ ) {
+    if ( digitalRead( pins[i].water_in ) || !digitalRead( pins[i].water_out ) ) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static void assert_volumes( void ) {
+  for ( uint8_t i = 0; i < TANK_COUNT; i++ ) {
+    TEST_ASSERT_INT_WITHIN( VOLUME_TOLERANCE, lround( level[i] ), tanks[i].volume() );
+  }
+}
+
+void setUp( void ) {}
+
+void tearDown( void ) {}
+
+// Both sensors share the ADC: each reads its own tank, at the
+// oversampling set through /config
+void test_scan_reads_every_tank( void ) {
+  uint16_t period = tanks[1].sensor.sample_period();
+  TEST_ASSERT_EQUAL_HEX8( COAP_CHANGED, request( COAP_PUT, 0, "config", "{\"oversample\":3}" ) );
+  TEST_ASSERT_EQUAL_HEX8( COAP_CONTENT, request( COAP_GET, 1, "config", NULL ) );
+  TEST_ASSERT_NOT_NULL( strstr( answer_payload(), "\"oversample\":3" ) );
+  TEST_ASSERT_LESS_THAN( period, tanks[1].sensor.sample_period() );
+  run( 2000 );
+  assert_volumes();
+  TEST_ASSERT_EQUAL( 0, twi.stats().timeouts );
+}
+
+// A range change that does not fit in the TWI pool is written before
+// the next read, no code is taken at the gain it replaces
+void test_config_retried_after_full_pool( void ) {
+  static const uint8_t probe[1] = { 0 };
+  volume_calibration_t c = volume_calibration_default;
+  c.full_scale_mv = 4096;
+  uint16_t configs = ads_configs;
+
+  bus_stalled = true;
+  while ( twi.submit( 0x50, probe, sizeof( probe ), 0 ) ) {
+  }
+  for ( uint8_t i = 0; i < TANK_COUNT; i++ ) {
+    tanks[i].sensor.calibrate( c );
+  }
+  bus_stalled = false;
+
+  uint32_t since = millis();
+  while ( millis() - since < 1000 ) {
+    step();
+    assert_volumes();
+  }
+  TEST_ASSERT_GREATER_THAN( configs, ads_configs );
+  TEST_ASSERT_EQUAL( 4096, pga_mv[( ads_config >> 9 ) & 0x07] );
+  TEST_ASSERT_GREATER_THAN( 0, twi.stats().errors );  // the probes
+
+  // Back to auto-ranging
+  for ( uint8_t i = 0; i < TANK_COUNT; i++ ) {
+    tanks[i].sensor.calibrate( volume_calibration_default );
+  }
+  run( 500 );
+  assert_volumes();
+}
+
+// /fill takes a target in dL, a retransmission gets the first answer
+// and does not start it again
+void test_fill_parsing_and_dedup( void ) {
+  TEST_ASSERT_EQUAL_HEX8( COAP_NOT_ACCEPTABLE, request( COAP_PUT, 1, "fill", "abc" ) );
+  TEST_ASSERT_EQUAL_HEX8( COAP_NOT_ACCEPTABLE, request( COAP_PUT, 1, "fill", "9000" ) );
+  TEST_ASSERT_TRUE( pumps_off() );
+
+  uint16_t mid = next_mid++;
+  TEST_ASSERT_EQUAL_HEX8( COAP_VALID, request( COAP_PUT, 1, "fill", "80", mid ) );
+  TEST_ASSERT_EQUAL( 80, tanks[1].control.fill_target );
+  TEST_ASSERT_TRUE( digitalRead( pins[1].water_in ) );
+  TEST_ASSERT_EQUAL_HEX8( COAP_VALID, request( COAP_PUT, 1, "fill", "0", mid ) );
+  TEST_ASSERT_EQUAL( 80, tanks[1].control.fill_target );
+  TEST_ASSERT_TRUE( digitalRead( pins[1].water_in ) );
+
+  TEST_ASSERT_EQUAL_HEX8( COAP_CHANGED, request( COAP_PUT, 1, "batch", "F-" ) );
+  TEST_ASSERT_TRUE( pumps_off() );
+  run( 500 );
+  assert_volumes();
+}
+
+// /transfer takes an amount in cl, less than the tank holds, and runs
+// until the tank is empty
+static bool tank0_empty( void ) {
+  return digitalRead( pins[0].water_out );
+}
+
+void test_transfer_parsing( void ) {
+  TEST_ASSERT_EQUAL_HEX8( COAP_NOT_ACCEPTABLE, request( COAP_PUT, 0, "transfer", "abc" ) );
+  TEST_ASSERT_EQUAL_HEX8( COAP_NOT_ACCEPTABLE, request( COAP_PUT, 0, "transfer", "5000" ) );
+  TEST_ASSERT_TRUE( pumps_off() );
+
+  TEST_ASSERT_EQUAL_HEX8( COAP_VALID, request( COAP_PUT, 0, "transfer", "100" ) );
+  TEST_ASSERT_FALSE( digitalRead( pins[0].water_out ) );
+  TEST_ASSERT_TRUE( run_until( tank0_empty, 10000 ) );
+  TEST_ASSERT_LESS_THAN( TANK_EMPTY + VOLUME_TOLERANCE, lround( level[0] ) );
+  run( 500 );
+  assert_volumes();
+}
+
+void test_unknown_tank( void ) {
+  TEST_ASSERT_EQUAL_HEX8( COAP_NOT_FOUNT, request( COAP_PUT, 5, "fill", "50" ) );
+  TEST_ASSERT_EQUAL_HEX8( COAP_NOT_FOUNT, request( COAP_GET, 2, "status", NULL ) );
+}
+
+// /batch applies every operation or none, checked against the state
+// the ones before leave
+void test_batch( void ) {
+  TEST_ASSERT_EQUAL_HEX8( COAP_BAD_REQUEST, request( COAP_PUT, 1, "batch", "F+ X1" ) );
+  TEST_ASSERT_EQUAL_HEX8( COAP_NOT_ACCEPTABLE, request( COAP_PUT, 1, "batch", "F9999,F+" ) );
+  TEST_ASSERT_EQUAL_STRING( "{\"refused\":0}", answer_payload() );
+  TEST_ASSERT_EQUAL_HEX8( COAP_NOT_ACCEPTABLE, request( COAP_PUT, 1, "batch", "F90 F+ T5000" ) );
+  TEST_ASSERT_EQUAL_STRING( "{\"refused\":2}", answer_payload() );
+  TEST_ASSERT_TRUE( pumps_off() );
+
+  TEST_ASSERT_EQUAL_HEX8( COAP_CHANGED, request( COAP_PUT, 1, "batch", "F90 F+ ?filling" ) );
+  TEST_ASSERT_EQUAL_STRING( "{\"filling\":1}", answer_payload() );
+  TEST_ASSERT_TRUE( digitalRead( pins[1].water_in ) );
+  run( 300 );
+  TEST_ASSERT_EQUAL_HEX8( COAP_CHANGED, request( COAP_PUT, 1, "batch", "F- ?filling" ) );
+  TEST_ASSERT_EQUAL_STRING( "{\"filling\":0}", answer_payload() );
+  TEST_ASSERT_TRUE( pumps_off() );
+  run( 500 );
+  assert_volumes();
+}
+
+// Filling stops at the target, in dL, or at max_volume, in cl,
+// whichever comes first, and stays stopped
+static bool tank0_stopped( void ) {
+  return !digitalRead( pins[0].water_in );
+}
+
+void test_fill_stops_at_target( void ) {
+  TEST_ASSERT_EQUAL_HEX8( COAP_VALID, request( COAP_PUT, 0, "fill", "50" ) );
+  TEST_ASSERT_TRUE( digitalRead( pins[0].water_in ) );
+  TEST_ASSERT_TRUE( run_until( tank0_stopped, 10000 ) );
+  TEST_ASSERT_INT_WITHIN( VOLUME_TOLERANCE, 500, lround( level[0] ) );
+  run( 1000 );
+  TEST_ASSERT_TRUE( pumps_off() );
+  assert_volumes();
+}
+
+void test_fill_stops_at_max_volume( void ) {
+  TEST_ASSERT_EQUAL_HEX8( COAP_CHANGED, request( COAP_PUT, 0, "config", "{\"max_volume\":800}" ) );
+  TEST_ASSERT_EQUAL_HEX8( COAP_VALID, request( COAP_PUT, 0, "fill", "90" ) );
+  TEST_ASSERT_TRUE( run_until( tank0_stopped, 10000 ) );
+  TEST_ASSERT_INT_WITHIN( VOLUME_TOLERANCE, 800, lround( level[0] ) );
+  run( 1000 );
+  TEST_ASSERT_TRUE( pumps_off() );
+  assert_volumes();
+
+  // Past max_volume already, a fill stops at once
+  TEST_ASSERT_EQUAL_HEX8( COAP_VALID, request( COAP_PUT, 0, "fill", "95" ) );
+  run( 200 );
+  TEST_ASSERT_TRUE( pumps_off() );
+  TEST_ASSERT_EQUAL_HEX8( COAP_CHANGED, request( COAP_PUT, 0, "config", "{\"max_volume\":9000}" ) );
+}
+
+int main( void ) {
+  memset( host_eeprom, 0xFF, sizeof( host_eeprom ) );
+  model.calibrate( volume_calibration_default );
+  level[0] = 300;
+  level[1] = 700;
+  plant_last = millis();
+  client_begin();
+  setup();
+
+  UNITY_BEGIN();
+  RUN_TEST( test_scan_reads_every_tank );
+  RUN_TEST( test_config_retried_after_full_pool );
+  RUN_TEST( test_fill_parsing_and_dedup );
+  RUN_TEST( test_transfer_parsing );
+  RUN_TEST( test_unknown_tank );
+  RUN_TEST( test_batch );
+  RUN_TEST( test_fill_stops_at_target );
+  RUN_TEST( test_fill_stops_at_max_volume );
+  return UNITY_END();
+}
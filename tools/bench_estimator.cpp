@@ -0,0 +1,144 @@
+// Host benchmark of VolumeEstimator against the 16-slot boxcar average
+// that Atm_volume_sensor::avg() applies, on a simulated brew day:
+// idle, fill, idle, transfer, idle, with pump dead time and noise.
+//
+//   g++ -O2 -std=c++11 -Iinclude tools/bench_estimator.cpp src/VolumeEstimator.cpp -o bench_estimator
+//   ./bench_estimator [noise_cl] [seed]
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "VolumeEstimator.hpp"
+
+static const int period_ms = 128;  // 64 codes at 860SPS, one tick every 2 ms
+
+struct sample_t {
+  double truth;
+  int16_t measured;
+  int8_t pumping;
+};
+
+// Same arithmetic as Atm_volume_sensor::avg()
+struct Boxcar {
+  uint16_t buf[16];
+  uint8_t head;
+  uint32_t total;
+  void begin( int v ) {
+    total = 0;
+    head = 0;
+    for ( int i = 0; i < 16; i++ ) {
+      buf[i] = v;
+      total += buf[i];
+    }
+  }
+  int update( int v ) {
+    total = total + (uint16_t)v - buf[head];
+    buf[head] = v;
+    head = ( head + 1 ) % 16;
+    return total / 16;
+  }
+};
+
+struct score_t {
+  double rms, max, lag_s;
+  double ns_per_update;
+};
+
+static std::vector<sample_t> brew_day( double noise, unsigned seed ) {
+  std::mt19937 rng( seed );
+  std::normal_distribution<double> gauss( 0, noise );
+  struct phase_t { double seconds; int8_t pumping; double flow; } phases[] = {
+    { 60, 0, 0 }, { 300, 1, 30 }, { 60, 0, 0 }, { 120, -1, -45 }, { 60, 0, 0 },
+  };
+  const double dead_time = 2.0;  // s between relay edge and flow change
+  std::vector<sample_t> out;
+  double volume = 4000, flow = 0, t = 0, edge = 0, target = 0;
+  int8_t pumping = 0;
+  for ( const phase_t& p : phases ) {
+    if ( p.pumping != pumping ) {
+      edge = t;
+      target = p.flow;
+      pumping = p.pumping;
+    }
+    for ( double end = t + p.seconds; t < end; t += period_ms / 1000.0 ) {
+      if ( t - edge >= dead_time ) flow = target;
+      volume += flow * period_ms / 1000.0;
+      // Pump ripple on top of white noise
+      double ripple = pumping ? noise * 0.5 * std::sin( t * 2 * M_PI * 1.3 ) : 0;
+      sample_t s;
+      s.truth = volume;
+      s.measured = (int16_t)std::lround( volume + gauss( rng ) + ripple );
+      s.pumping = pumping;
+      out.push_back( s );
+    }
+  }
+  return out;
+}
+
+template <class F>
+static score_t score( const std::vector<sample_t>& trace, F filter ) {
+  std::vector<int> estimates( trace.size() );
+  auto start = std::chrono::steady_clock::now();
+  const int repeat = 200;
+  for ( int r = 0; r < repeat; r++ ) {
+    filter.reset( trace[0].measured );
+    for ( size_t i = 0; i < trace.size(); i++ ) {
+      estimates[i] = filter.update( trace[i].measured, trace[i].pumping );
+    }
+  }
+  auto took = std::chrono::steady_clock::now() - start;
+
+  score_t s = { 0, 0, 0, 0 };
+  double ramp_error = 0, ramp_slope = 0;
+  for ( size_t i = 1; i < trace.size(); i++ ) {
+    double e = estimates[i] - trace[i].truth;
+    s.rms += e * e;
+    s.max = std::max( s.max, std::fabs( e ) );
+    double slope = ( trace[i].truth - trace[i - 1].truth ) * 1000.0 / period_ms;
+    if ( std::fabs( slope ) > 1 ) {
+      ramp_error += -e * slope;
+      ramp_slope += slope * slope;
+    }
+  }
+  s.rms = std::sqrt( s.rms / trace.size() );
+  s.lag_s = ramp_slope > 0 ? ramp_error / ramp_slope : 0;
+  s.ns_per_update = std::chrono::duration<double, std::nano>( took ).count() / ( repeat * trace.size() );
+  return s;
+}
+
+struct RawFilter {
+  void reset( int ) {}
+  int update( int v, int8_t ) { return v; }
+};
+
+struct BoxcarFilter {
+  Boxcar b;
+  void reset( int v ) { b.begin( v ); }
+  int update( int v, int8_t ) { return b.update( v ); }
+};
+
+struct EstimatorFilter {
+  VolumeEstimator e;
+  void reset( int ) { e.begin( period_ms ); }
+  int update( int v, int8_t pumping ) { return e.update( v, pumping ); }
+};
+
+int main( int argc, char** argv ) {
+  double noise = argc > 1 ? atof( argv[1] ) : 15;
+  unsigned seed = argc > 2 ? atoi( argv[2] ) : 1;
+  std::vector<sample_t> trace = brew_day( noise, seed );
+
+  printf( "%zu samples every %d ms, noise %.1f cl\n", trace.size(), period_ms, noise );
+  printf( "%-12s %10s %10s %10s %12s\n", "filter", "rms cl", "max cl", "lag s", "ns/update" );
+  score_t r = score( trace, RawFilter() );
+  printf( "%-12s %10.1f %10.1f %10.2f %12.1f\n", "raw", r.rms, r.max, r.lag_s, r.ns_per_update );
+  r = score( trace, BoxcarFilter() );
+  printf( "%-12s %10.1f %10.1f %10.2f %12.1f\n", "avg() x16", r.rms, r.max, r.lag_s, r.ns_per_update );
+  r = score( trace, EstimatorFilter() );
+  printf( "%-12s %10.1f %10.1f %10.2f %12.1f\n", "estimator", r.rms, r.max, r.lag_s, r.ns_per_update );
+  return 0;
+}
@@ -0,0 +1,373 @@
+#!/usr/bin/env python3
+"""Drive the CoAP server in src/main.cpp with concurrent clients.
+
+Each client keeps one request in flight, picking resources from a
+weighted mix, and sends a share of them confirmable (CON, retransmitted
+as in RFC 7252 4.2) and the rest non-confirmable (NON). At the end the
+request latency percentiles and response codes are printed next to the
+firmware's own counters, read from /tasks and /ingress before and after
+the run.
+
+    tools/coap_load.py 192.168.1.177 --clients 4 --duration 30
+    tools/coap_load.py 192.168.1.177 --mix status=8,window=1,tasks=1 --con-ratio 0.5
+
+Or against the host build of the firmware, which serves the same
+handlers through CoapIngress on 127.0.0.1 (env:native in
+platformio.ini):
+
+    pio run -e native && .pio/build/native/program &
+    tools/coap_load.py 127.0.0.1 --clients 8 --duration 30
+
+The mix is read-only: every resource is fetched with GET. /fill,
+/transfer and /batch act on the pumps whatever they are sent, even "0"
+stops a running one, so they are only accepted with an explicit
+--fill/--transfer/--batch payload, sent with PUT.
+"""
+
+import argparse
+import json
+import random
+import select
+import socket
+import struct
+import sys
+import time
+
+CON, NON, ACK, RST = 0, 1, 2, 3
+GET, POST, PUT = 1, 2, 3
+OPTION_URI_PATH = 11
+
+# Resources that act on the pumps, see run()
+COMMANDS = ("fill", "transfer", "batch")
+
+# RFC 7252 4.8 transmission parameters
+ACK_TIMEOUT = 2.0
+ACK_RANDOM_FACTOR = 1.5
+MAX_RETRANSMIT = 4
+NON_TIMEOUT = 2.0
+
+
+def encode_option(delta, value):
+    def nibble(n):
+        if n < 13:
+            return n, b""
+        if n < 269:
+            return 13, bytes([n - 13])
+        return 14, struct.pack("!H", n - 269)
+    d, dext = nibble(delta)
+    l, lext = nibble(len(value))
+    return bytes([(d << 4) | l]) + dext + lext + value
+
+
+def encode(mtype, code, mid, token, path, payload=b""):
+    out = bytearray([0x40 | (mtype << 4) | len(token), code])
+    out += struct.pack("!H", mid) + token
+    last = 0
+    for segment in path.strip("/").split("/"):
+        out += encode_option(OPTION_URI_PATH - last, segment.encode())
+        last = OPTION_URI_PATH
+    if payload:
+        out += b"\xff" + payload
+    return bytes(out)
+
+
+def decode(datagram):
+    """Returns (type, code, mid, token, payload) or None."""
+    if len(datagram) < 4 or datagram[0] >> 6 != 1:
+        return None
+    mtype = (datagram[0] >> 4) & 3
+    tkl = datagram[0] & 0x0F
+    code = datagram[1]
+    mid = struct.unpack("!H", datagram[2:4])[0]
+    token = datagram[4:4 + tkl]
+    i = 4 + tkl
+    while i < len(datagram) and datagram[i] != 0xFF:
+        d, l = datagram[i] >> 4, datagram[i] & 0x0F
+        i += 1
+        for n in (d, l):
+            if n == 13:
+                i += 1
+            elif n == 14:
+                i += 2
+        if l == 13:
+            l = datagram[i - 1] + 13
+        elif l == 14:
+            l = struct.unpack("!H", datagram[i - 2:i])[0] + 269
+        i += l
+    payload = datagram[i + 1:] if i < len(datagram) else b""
+    return mtype, code, mid, token, payload
+
+
+def code_name(code):
+    return "%d.%02d" % (code >> 5, code & 0x1F)
+
+
+class Client:
+    def __init__(self, target, mix, con_ratio, payloads, rng):
+        self.sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        self.sock.setblocking(False)
+        self.target = target
+        self.mix = mix
+        self.con_ratio = con_ratio
+        self.payloads = payloads
+        self.rng = rng
+        self.mid = rng.randrange(0x10000)
+        self.pending = None
+        self.next_send = 0.0
+
+    def start(self, now):
+        resources, weights = zip(*self.mix)
+        path = self.rng.choices(resources, weights)[0]
+        mtype = CON if self.rng.random() < self.con_ratio else NON
+        payload = self.payloads.get(path, b"")
+        method = PUT if payload else GET
+        self.mid = (self.mid + 1) & 0xFFFF
+        token = struct.pack("!I", self.rng.getrandbits(32))
+        datagram = encode(mtype, method, self.mid, token, path, payload)
+        timeout = ACK_TIMEOUT * self.rng.uniform(1, ACK_RANDOM_FACTOR) \
+            if mtype == CON else NON_TIMEOUT
+        self.pending = {
+            "path": path, "type": mtype, "token": token, "mid": self.mid,
+            "datagram": datagram, "sent": now, "deadline": now + timeout,
+            "timeout": timeout, "retransmits": 0,
+        }
+        self.sock.sendto(datagram, self.target)
+
+    def expire(self, now, stats):
+        p = self.pending
+        if p is None or now < p["deadline"]:
+            return
+        if p["type"] == CON and p["retransmits"] < MAX_RETRANSMIT:
+            p["retransmits"] += 1
+            p["timeout"] *= 2
+            p["deadline"] = now + p["timeout"]
+            stats.retransmits += 1
+            self.sock.sendto(p["datagram"], self.target)
+            return
+        stats.record(p["path"], p["type"], "timeout", None)
+        self.pending = None
+
+    def receive(self, now, stats):
+        while True:
+            try:
+                datagram = self.sock.recv(1500)
+            except BlockingIOError:
+                return
+            message = decode(datagram)
+            p = self.pending
+            if message is None or p is None:
+                stats.stray += 1
+                continue
+            mtype, code, mid, token, _ = message
+            if mtype == ACK and code == 0 and mid == p["mid"]:
+                # Empty ACK, a separate response would follow
+                p["deadline"] = now + NON_TIMEOUT
+                p["type"] = NON
+                continue
+            if mtype == RST and mid == p["mid"]:
+                stats.record(p["path"], p["type"], "RST", now - p["sent"])
+                self.pending = None
+                continue
+            # Coap::sendResponse() answers even NON requests with a
+            # piggybacked ACK and no token, so the MID has to do
+            if token != p["token"] and not (mtype == ACK and mid == p["mid"]):
+                stats.stray += 1
+                continue
+            if mtype == CON:
+                self.sock.sendto(encode(ACK, 0, mid, b"", ""), self.target)
+            stats.record(p["path"], p["type"], code_name(code), now - p["sent"])
+            self.pending = None
+
+
+class Stats:
+    def __init__(self):
+        self.latencies = {}
+        self.codes = {}
+        self.retransmits = 0
+        self.stray = 0
+
+    def record(self, path, mtype, outcome, latency):
+        key = (path, "CON" if mtype == CON else "NON")
+        codes = self.codes.setdefault(key, {})
+        codes[outcome] = codes.get(outcome, 0) + 1
+        if latency is not None:
+            self.latencies.setdefault(key, []).append(latency)
+
+
+def percentile(values, p):
+    values = sorted(values)
+    return values[min(len(values) - 1, int(round(p / 100.0 * (len(values) - 1))))]
+
+
+def fetch_json(target, path, timeout=2.0):
+    """One CON GET, retried a few times, None if the board never answers."""
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    try:
+        for attempt in range(3):
+            mid = random.randrange(0x10000)
+            token = struct.pack("!H", mid)
+            sock.sendto(encode(CON, GET, mid, token, path), target)
+            deadline = time.monotonic() + timeout
+            while time.monotonic() < deadline:
+                ready, _, _ = select.select([sock], [], [],
+                                            deadline - time.monotonic())
+                if not ready:
+                    break
+                message = decode(sock.recv(1500))
+                if message and message[2] == mid and message[1] >> 5 == 2:
+                    try:
+                        return json.loads(message[4].decode())
+                    except ValueError:
+                        return None
+    finally:
+        sock.close()
+    return None
+
+
+def firmware_counters(target):
+    return fetch_json(target, "tasks"), fetch_json(target, "ingress")
+
+
+def parse_mix(text):
+    mix = []
+    for item in text.split(","):
+        path, _, weight = item.partition("=")
+        mix.append((path.strip(), float(weight or 1)))
+    return mix
+
+
+def run(args):
+    target = (args.host, args.port)
+    rng = random.Random(args.seed)
+    payloads = {}
+    for path in COMMANDS:
+        payload = getattr(args, path)
+        if payload is not None:
+            payloads[path] = payload.encode()
+        elif any(p == path for p, _ in args.mix):
+            sys.exit("/%s acts on the pumps, give its payload with --%s"
+                     % (path, path))
+
+    before = firmware_counters(target)
+    stats = Stats()
+    clients = [Client(target, args.mix, args.con_ratio, payloads,
+                      random.Random(rng.getrandbits(32)))
+               for _ in range(args.clients)]
+    interval = 1.0 / args.rate if args.rate else 0.0
+
+    start = time.monotonic()
+    end = start + args.duration
+    for i, client in enumerate(clients):
+        # Spread the first requests over one interval
+        client.next_send = start + interval * i / len(clients)
+    draining = False
+    while True:
+        now = time.monotonic()
+        if now >= end:
+            draining = True
+        busy = False
+        for client in clients:
+            client.expire(now, stats)
+            if client.pending is None and not draining and now >= client.next_send:
+                client.start(now)
+                client.next_send = max(now, client.next_send + interval)
+            busy = busy or client.pending is not None
+        if draining and not busy:
+            break
+        wait = min([c.pending["deadline"] for c in clients if c.pending] +
+                   [c.next_send for c in clients if not draining] + [now + 0.1])
+        ready, _, _ = select.select([c.sock for c in clients], [], [],
+                                    max(0.0, wait - now))
+        now = time.monotonic()
+        for client in clients:
+            if client.sock in ready:
+                client.receive(now, stats)
+    elapsed = time.monotonic() - start
+    after = firmware_counters(target)
+    report(args, stats, elapsed, before, after)
+
+
+def report(args, stats, elapsed, before, after):
+    print("%d client(s), %.1f s, mix %s, %.0f%% CON" % (
+        args.clients, elapsed,
+        ",".join("%s=%g" % m for m in args.mix), args.con_ratio * 100))
+    print("%-10s %4s %7s %8s %8s %8s %8s  %s" % (
+        "resource", "type", "count", "p50 ms", "p90 ms", "p99 ms",
+        "max ms", "codes"))
+    total = 0
+    for key in sorted(stats.codes):
+        latencies = stats.latencies.get(key, [])
+        count = sum(stats.codes[key].values())
+        total += count
+        codes = " ".join("%s:%d" % c for c in sorted(stats.codes[key].items()))
+        if latencies:
+            ms = [percentile(latencies, p) * 1000 for p in (50, 90, 99, 100)]
+            print("%-10s %4s %7d %8.1f %8.1f %8.1f %8.1f  %s"
+                  % ((key[0], key[1], count) + tuple(ms) + (codes,)))
+        else:
+            print("%-10s %4s %7d %8s %8s %8s %8s  %s"
+                  % (key[0], key[1], count, "-", "-", "-", "-", codes))
+    print("%d request(s), %.1f req/s, %d retransmission(s), %d stray datagram(s)"
+          % (total, total / elapsed, stats.retransmits, stats.stray))
+
+    tasks_before, ingress_before = before
+    tasks_after, ingress_after = after
+    if tasks_after:
+        # Peaks are since the previous /tasks query, here the one before
+        # the run, the other counters since boot
+        print("firmware tasks [peak us, overruns, yields] during the run:")
+        for name, values in sorted(tasks_after.items()):
+            if name in ("loop", "twi"):
+                continue
+            if tasks_before and name in tasks_before:
+                values = [values[0]] + [(a - b) & 0xFFFF for a, b in
+                                        zip(values[1:], tasks_before[name][1:])]
+            print("  %-10s %s" % (name, values))
+        if "loop" in tasks_after:
+            peak, loops = tasks_after["loop"]
+            line = "  loop peak %d us" % peak
+            if tasks_before and "loop" in tasks_before:
+                ran = (loops - tasks_before["loop"][1]) & 0xFFFFFFFF
+                line += ", %d iteration(s), mean %.0f us" % (
+                    ran, elapsed * 1e6 / ran if ran else 0)
+            print(line)
+        if "twi" in tasks_after:
+            twi = tasks_after["twi"]
+            if tasks_before and "twi" in tasks_before:
+                twi = [(a - b) & 0xFFFF for a, b in zip(twi, tasks_before["twi"])]
+            print("  twi done %d, errors %d, timeouts %d, rejected %d" % tuple(twi))
+    else:
+        print("firmware /tasks did not answer")
+    if ingress_after:
+        delta = dict(ingress_after)
+        if ingress_before:
+            for name in ("queued", "dropped", "rejected", "served"):
+                if name in delta and name in ingress_before:
+                    delta[name] = (delta[name] - ingress_before[name]) & 0xFFFF
+        print("firmware ingress: " + ", ".join(
+            "%s %s" % item for item in sorted(delta.items())))
+    else:
+        print("firmware /ingress did not answer")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("host", help="board address, or 127.0.0.1 for a host build")
+    parser.add_argument("--port", type=int, default=5683)
+    parser.add_argument("--clients", type=int, default=1)
+    parser.add_argument("--duration", type=float, default=10, help="seconds")
+    parser.add_argument("--rate", type=float, default=0,
+                        help="requests/s per client, 0 for back to back")
+    parser.add_argument("--mix", type=parse_mix, default=parse_mix("status"),
+                        help="weighted resources, e.g. status=8,window=1,tasks=1")
+    parser.add_argument("--con-ratio", type=float, default=1.0,
+                        help="share of confirmable requests, 0 to 1")
+    parser.add_argument("--fill", help="/fill payload, dL, allows fill in the mix")
+    parser.add_argument("--transfer", help="/transfer payload, cl, allows transfer in the mix")
+    parser.add_argument("--batch", help="/batch payload, allows batch in the mix")
+    parser.add_argument("--seed", type=int, default=1)
+    run(parser.parse_args())
+
+
+if __name__ == "__main__":
+    main()
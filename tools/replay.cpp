@@ -0,0 +1,253 @@
+// Replays a field trace through the volume pipeline on a virtual clock
+// and prints the control decisions it leads to, one CSV line each. Run
+// it from two checkouts and compare the outputs with replay_diff.py to
+// see what a filter or scheduling change does to real brew-day data.
+//
+// The trace is the CSV written by telemetry_decode.py. Every tick_ms of
+// virtual time the latest recorded code is fed to VolumeConversion, the
+// PGA auto-ranging, oversampling, zero trim, estimator and deadband of
+// Atm_volume_sensor, then TankControl, the fill / transfer rules and
+// auto-zero of Tank. Both are linked from src/, as the firmware does.
+// Commands, standing in for the /fill, /transfer and /batch requests,
+// come from an optional events CSV:
+// timestamp,fill|transfer|fill_stop|transfer_stop[,value].
+//
+// The bus, the scan of several sensors and the CoAP handlers are not
+// replayed, test/test_native runs those on the host.
+//
+// Relay edges recorded in the trace are printed as well, source
+// "field", so the replay can also be checked against what the board
+// did.
+//
+//   tools/telemetry_decode.py capture.bin --file > trace.csv
+//   g++ -O2 -std=c++11 -Iinclude -o replay tools/replay.cpp src/VolumeConversion.cpp src/TankControl.cpp
+//     src/SampleWindow.cpp src/DeadTime.cpp src/VolumeEstimator.cpp
+//   ./replay [-e events.csv] [-t tick_ms] [-s oversample] [-m max_volume] trace.csv > decisions.csv
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "TankControl.hpp"
+#include "VolumeConversion.hpp"
+
+struct record_t {
+  uint32_t timestamp;
+  int16_t code;
+  uint16_t full_scale_mv;
+  bool filling, transferring;
+};
+
+enum { EVENT_FILL, EVENT_TRANSFER, EVENT_FILL_STOP, EVENT_TRANSFER_STOP };
+
+struct event_t {
+  uint32_t timestamp;
+  uint8_t command;
+  int value;
+};
+
+struct decision_t {
+  uint32_t timestamp;
+  const char* source;
+  std::string decision;
+  int volume;
+};
+
+// Columns by header name, telemetry_decode.py output
+static bool load_trace( const char* path, std::vector<record_t>& trace ) {
+  FILE* f = fopen( path, "r" );
+  if ( !f ) return false;
+  char line[512];
+  int col_ts = -1, col_code = -1, col_fs = -1, col_fill = -1, col_tx = -1;
+  if ( fgets( line, sizeof( line ), f ) ) {
+    int i = 0;
+    for ( char* name = strtok( line, ",\r\n" ); name; name = strtok( NULL, ",\r\n" ), i++ ) {
+      if ( !strcmp( name, "timestamp" ) ) col_ts = i;
+      if ( !strcmp( name, "code" ) ) col_code = i;
+      if ( !strcmp( name, "fs_mv" ) ) col_fs = i;
+      if ( !strcmp( name, "filling" ) ) col_fill = i;
+      if ( !strcmp( name, "transferring" ) ) col_tx = i;
+    }
+  }
+  if ( col_ts < 0 || col_code < 0 ) {
+    fclose( f );
+    return false;
+  }
+  while ( fgets( line, sizeof( line ), f ) ) {
+    std::vector<long> v;
+    for ( char* field = strtok( line, ",\r\n" ); field; field = strtok( NULL, ",\r\n" ) ) {
+      v.push_back( strtol( field, NULL, 10 ) );
+    }
+    if ( (int)v.size() <= col_code || (int)v.size() <= col_ts ) continue;
+    record_t r;
+    r.timestamp = v[col_ts];
+    r.code = v[col_code];
+    // Traces from before auto-ranging were all taken at 2048 mV
+    r.full_scale_mv = col_fs >= 0 && v[col_fs] > 0 ? v[col_fs] : 2048;
+    r.filling = col_fill >= 0 && v[col_fill];
+    r.transferring = col_tx >= 0 && v[col_tx];
+    trace.push_back( r );
+  }
+  fclose( f );
+  return !trace.empty();
+}
+
+static bool load_events( const char* path, std::vector<event_t>& events ) {
+  static const char* const commands[] = { "fill", "transfer", "fill_stop", "transfer_stop" };
+  FILE* f = fopen( path, "r" );
+  if ( !f ) return false;
+  char line[128], command[16];
+  while ( fgets( line, sizeof( line ), f ) ) {
+    event_t e;
+    e.value = 0;
+    if ( sscanf( line, "%u,%15[a-z_],%d", &e.timestamp, command, &e.value ) < 2 ) continue;
+    for ( e.command = 0; e.command < 4 && strcmp( command, commands[e.command] ); e.command++ ) {
+    }
+    if ( e.command < 4 ) events.push_back( e );
+  }
+  fclose( f );
+  return true;
+}
+
+// Pump edges between two TankControl::pumping() values
+static void pump_edges( uint32_t t, int8_t before, int8_t after, int volume, std::vector<decision_t>& out ) {
+  if ( before > 0 && after <= 0 ) out.push_back( { t, "replay", "fill_off", volume } );
+  if ( before < 0 && after >= 0 ) out.push_back( { t, "replay", "transfer_off", volume } );
+  if ( after > 0 && before <= 0 ) out.push_back( { t, "replay", "fill_on", volume } );
+  if ( after < 0 && before >= 0 ) out.push_back( { t, "replay", "transfer_on", volume } );
+}
+
+// What the handlers of main.cpp ask of Tank
+static void command( TankControl& control, const event_t& e, int volume, std::vector<decision_t>& out ) {
+  int8_t before = control.pumping();
+  switch ( e.command ) {
+    case EVENT_FILL:
+      if ( !control.fill( e.value ) ) out.push_back( { e.timestamp, "replay", "fill_rejected", volume } );
+      break;
+    case EVENT_TRANSFER:
+      if ( !control.transfer( e.value, volume ) ) out.push_back( { e.timestamp, "replay", "transfer_rejected", volume } );
+      break;
+    case EVENT_FILL_STOP:
+      control.stop_filling();
+      break;
+    case EVENT_TRANSFER_STOP:
+      control.stop_transferring();
+      break;
+  }
+  pump_edges( e.timestamp, before, control.pumping(), volume, out );
+}
+
+// Recorded code at full_scale_mv as the ADC would read it in the
+// current range, clipped like the ADC
+static int16_t rescale( const record_t& r, VolumeConversion& conversion ) {
+  int32_t code = (int32_t)r.code * ( r.full_scale_mv / 256 ) / conversion.lsb();
+  return code > 32767 ? 32767 : code < -32768 ? -32768 : code;
+}
+
+struct replay_t {
+  size_t ticks;
+  size_t publishes;
+};
+
+// One pass over the trace, in the order of a loop(): the conversion
+// read back, the commands, then Tank::poll()
+static replay_t replay( const std::vector<record_t>& trace, const std::vector<event_t>& events,
+                        uint16_t tick_ms, uint8_t shift, int max_volume, std::vector<decision_t>& out ) {
+  VolumeConversion conversion = VolumeConversion();
+  SampleWindow window = SampleWindow();
+  VolumeEstimator estimator = VolumeEstimator();
+  TankControl control = TankControl();
+  conversion.calibrate( volume_calibration_default );
+  conversion.oversample( shift );
+  conversion.period( tick_ms << shift );
+  conversion.window( &window.begin() );
+  conversion.estimate( &estimator );
+  conversion.threshold( VOLUME_DEADBAND );
+  control.begin( max_volume );
+
+  replay_t stats = { 0, 0 };
+  size_t r = 0, e = 0;
+  for ( uint32_t t = trace.front().timestamp; t <= trace.back().timestamp; t += tick_ms, stats.ticks++ ) {
+    while ( r + 1 < trace.size() && trace[r + 1].timestamp <= t ) r++;
+    uint8_t range = conversion.range();
+    conversion.take( true, rescale( trace[r], conversion ), t, control.pumping() );
+    if ( conversion.range() != range ) {
+      out.push_back( { t, "replay", "pga_" + std::to_string( conversion.full_scale() ), conversion.volume() } );
+    }
+    if ( conversion.due() ) {
+      conversion.sent();
+      stats.publishes++;
+    }
+    while ( e < events.size() && events[e].timestamp <= t ) command( control, events[e++], conversion.volume(), out );
+    int8_t before = control.pumping();
+    bool drained = control.run( conversion.volume(), conversion.flow(), t, window );
+    pump_edges( t, before, control.pumping(), conversion.volume(), out );
+    if ( drained ) {
+      bool ok = conversion.zero( ZERO_EMPTY );
+      out.push_back( { t, "replay", ok ? "zero" : "zero_refused", conversion.volume() } );
+    }
+  }
+  return stats;
+}
+
+int main( int argc, char** argv ) {
+  const char* events_path = NULL;
+  uint16_t tick_ms = 2;  // conversion_delay at 860SPS
+  uint8_t shift = 6;     // 64 codes per output sample
+  int max_volume = 9000;
+  int i = 1;
+  for ( ; i + 1 < argc && argv[i][0] == '-'; i += 2 ) {
+    if ( !strcmp( argv[i], "-e" ) ) events_path = argv[i + 1];
+    if ( !strcmp( argv[i], "-t" ) ) tick_ms = atoi( argv[i + 1] );
+    if ( !strcmp( argv[i], "-s" ) ) shift = atoi( argv[i + 1] );
+    if ( !strcmp( argv[i], "-m" ) ) max_volume = atoi( argv[i + 1] );
+  }
+  if ( i >= argc || tick_ms == 0 || shift > 8 ) {
+    fprintf( stderr, "usage: %s [-e events.csv] [-t tick_ms] [-s oversample] [-m max_volume] trace.csv\n", argv[0] );
+    return 2;
+  }
+
+  std::vector<record_t> trace;
+  std::vector<event_t> events;
+  if ( !load_trace( argv[i], trace ) ) {
+    fprintf( stderr, "%s: no samples\n", argv[i] );
+    return 1;
+  }
+  if ( events_path && !load_events( events_path, events ) ) {
+    fprintf( stderr, "%s: cannot read\n", events_path );
+    return 1;
+  }
+
+  std::vector<decision_t> decisions;
+  for ( size_t j = 1; j < trace.size(); j++ ) {
+    if ( trace[j].filling != trace[j - 1].filling ) {
+      decisions.push_back( { trace[j].timestamp, "field", trace[j].filling ? "fill_on" : "fill_off", 0 } );
+    }
+    if ( trace[j].transferring != trace[j - 1].transferring ) {
+      decisions.push_back( { trace[j].timestamp, "field", trace[j].transferring ? "transfer_on" : "transfer_off", 0 } );
+    }
+  }
+
+  // Repeated for a stable per-tick cost, the last pass is printed
+  std::vector<decision_t> replayed;
+  replay_t stats;
+  const int repeat = 20;
+  auto start = std::chrono::steady_clock::now();
+  for ( int r = 0; r < repeat; r++ ) {
+    replayed.clear();
+    stats = replay( trace, events, tick_ms, shift, max_volume, replayed );
+  }
+  auto took = std::chrono::steady_clock::now() - start;
+  decisions.insert( decisions.end(), replayed.begin(), replayed.end() );
+
+  printf( "# %zu records, %zu ticks of %u ms, %zu published, %.1f ns/tick\n", trace.size(), stats.ticks, tick_ms,
+          stats.publishes, std::chrono::duration<double, std::nano>( took ).count() / ( repeat * stats.ticks ) );
+  printf( "timestamp,source,decision,volume\n" );
+  for ( const decision_t& d : decisions ) {
+    printf( "%u,%s,%s,%d\n", d.timestamp, d.source, d.decision.c_str(), d.volume );
+  }
+  return 0;
+}
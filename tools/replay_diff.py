@@ -0,0 +1,82 @@
+#!/usr/bin/env python3
+"""Compare the control decisions of two replay runs.
+
+Decisions are paired in order per source (replay, field) and decision
+name. The timing difference of every pair is printed, with decisions
+only one run took and the per-tick cost of both. Exits 1 when the runs
+disagree beyond the tolerance, so it can gate a filter change.
+
+    git worktree add /tmp/base HEAD~1
+    g++ -O2 -std=c++11 -I/tmp/base/include -o replay_base \\
+        /tmp/base/tools/replay.cpp /tmp/base/src/VolumeConversion.cpp \\
+        /tmp/base/src/TankControl.cpp /tmp/base/src/SampleWindow.cpp \\
+        /tmp/base/src/DeadTime.cpp /tmp/base/src/VolumeEstimator.cpp
+    g++ -O2 -std=c++11 -Iinclude -o replay tools/replay.cpp \\
+        src/VolumeConversion.cpp src/TankControl.cpp src/SampleWindow.cpp \\
+        src/DeadTime.cpp src/VolumeEstimator.cpp
+    ./replay_base -e events.csv trace.csv > base.csv
+    ./replay -e events.csv trace.csv > new.csv
+    tools/replay_diff.py base.csv new.csv
+"""
+
+import argparse
+import csv
+import itertools
+import sys
+
+
+def load(path):
+    """Returns ({(source, decision): [(timestamp, volume)]}, header comment)."""
+    decisions = {}
+    comment = ""
+    with open(path) as f:
+        lines = []
+        for line in f:
+            if line.startswith("#"):
+                comment = line[1:].strip()
+            else:
+                lines.append(line)
+    for row in csv.DictReader(lines):
+        key = (row["source"], row["decision"])
+        decisions.setdefault(key, []).append((int(row["timestamp"]),
+                                              int(row["volume"])))
+    return decisions, comment
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("base")
+    parser.add_argument("new")
+    parser.add_argument("--tolerance", type=int, default=0,
+                        help="ms a decision may move without failing")
+    args = parser.parse_args()
+
+    base, base_comment = load(args.base)
+    new, new_comment = load(args.new)
+    print("base: %s" % base_comment)
+    print("new:  %s" % new_comment)
+
+    failed = False
+    print("%-8s %-18s %10s %10s %8s %8s" % ("source", "decision", "base ms",
+                                            "new ms", "delta", "dvol cl"))
+    for key in sorted(set(base) | set(new)):
+        pairs = itertools.zip_longest(base.get(key, []), new.get(key, []))
+        for b, n in pairs:
+            if b is None or n is None:
+                failed = True
+                print("%-8s %-18s %10s %10s %8s %8s" % (
+                    key[0], key[1], b[0] if b else "-", n[0] if n else "-",
+                    "only", ""))
+                continue
+            delta = n[0] - b[0]
+            if abs(delta) > args.tolerance:
+                failed = True
+            if delta or n[1] != b[1]:
+                print("%-8s %-18s %10d %10d %+8d %+8d" % (
+                    key[0], key[1], b[0], n[0], delta, n[1] - b[1]))
+    print("different" if failed else "same decisions")
+    sys.exit(1 if failed else 0)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,130 @@
+#!/usr/bin/env python3
+"""Receive the SenML batches the board pushes to coap://<host>/senml.
+
+Stands in for the real collector during bench tests: listens for the
+non-confirmable CoAP POSTs, resolves the base name and the relative
+times against the arrival time, and prints one line per record or
+appends them to a CSV file.
+
+    tools/senml_collector.py --csv pushes.csv
+    coap-client -m put -e '{"ip":"192.168.1.10"}' coap://<board>/push
+"""
+
+import argparse
+import csv
+import json
+import socket
+import struct
+import sys
+import time
+
+COAP_POST = 0x02
+COAP_URI_PATH = 11
+COAP_CONTENT_FORMAT = 12
+SENML_JSON = 110
+
+
+def parse_coap(datagram):
+    """Returns (type, code, message id, {option: [values]}, payload)."""
+    if len(datagram) < 4:
+        raise ValueError("short datagram")
+    first, code, mid = struct.unpack_from(">BBH", datagram)
+    if first >> 6 != 1:
+        raise ValueError("not CoAP version 1")
+    pos = 4 + (first & 0x0F)  # token
+    number = 0
+    options = {}
+    while pos < len(datagram):
+        if datagram[pos] == 0xFF:
+            pos += 1
+            break
+        delta, length = datagram[pos] >> 4, datagram[pos] & 0x0F
+        pos += 1
+        # extended delta / length, RFC 7252 3.1
+        values = []
+        for nibble in (delta, length):
+            if nibble == 13:
+                values.append(datagram[pos] + 13)
+                pos += 1
+            elif nibble == 14:
+                values.append(struct.unpack_from(">H", datagram, pos)[0] + 269)
+                pos += 2
+            else:
+                values.append(nibble)
+        number += values[0]
+        options.setdefault(number, []).append(datagram[pos:pos + values[1]])
+        pos += values[1]
+    return (first >> 4) & 0x03, code, mid, options, datagram[pos:]
+
+
+def resolve(pack, received):
+    """SenML records with absolute names and times, RFC 8428 4.6."""
+    base_name, base_time = "", 0.0
+    for r in pack:
+        base_name = r.get("bn", base_name)
+        base_time = r.get("bt", base_time)
+        t = base_time + r.get("t", 0.0)
+        # relative times are below 2^28 s
+        if t < 2 ** 28:
+            t += received
+        value = r.get("v", r.get("vb", r.get("vs")))
+        yield base_name + r.get("n", ""), t, value, r.get("u", "")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--bind", default="0.0.0.0")
+    parser.add_argument("--port", type=int, default=5683)
+    parser.add_argument("--csv", help="append records to this file")
+    args = parser.parse_args()
+
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.bind((args.bind, args.port))
+    out = None
+    if args.csv:
+        f = open(args.csv, "a", newline="")
+        out = csv.writer(f)
+        if f.tell() == 0:
+            out.writerow(["time", "name", "value", "unit", "source"])
+
+    last_mid = {}
+    while True:
+        datagram, source = sock.recvfrom(2048)
+        received = time.time()
+        try:
+            kind, code, mid, options, payload = parse_coap(datagram)
+        except (ValueError, IndexError, struct.error) as e:
+            print("%s: %s" % (source[0], e), file=sys.stderr)
+            continue
+        path = "/".join(o.decode() for o in options.get(COAP_URI_PATH, []))
+        formats = options.get(COAP_CONTENT_FORMAT, [b""])
+        fmt = int.from_bytes(formats[0], "big")
+        if code != COAP_POST or path != "senml" or fmt != SENML_JSON:
+            print("%s: ignored code %d.%02d /%s format %d" % (
+                source[0], code >> 5, code & 0x1F, path, fmt), file=sys.stderr)
+            continue
+        if last_mid.get(source) == mid:
+            continue  # duplicate
+        last_mid[source] = mid
+        try:
+            pack = json.loads(payload.decode())
+        except ValueError as e:
+            print("%s: bad SenML: %s" % (source[0], e), file=sys.stderr)
+            continue
+
+        records = list(resolve(pack, received))
+        print("%s: batch %d, %d records, %d bytes" % (
+            source[0], mid, len(records), len(datagram)))
+        for name, t, value, unit in records:
+            if out:
+                out.writerow(["%.3f" % t, name, value, unit, source[0]])
+            else:
+                print("  %s %-40s %s %s" % (
+                    time.strftime("%H:%M:%S", time.localtime(t)), name,
+                    value, unit))
+        if out:
+            f.flush()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,98 @@
+#!/usr/bin/env python3
+"""Static SRAM used by each module of the firmware.
+
+Sums the .data, .bss and .rodata symbols of every object file in a
+PlatformIO build directory (on AVR .rodata is copied to SRAM too, only
+PROGMEM stays in flash) and prints them largest first, with the totals
+of the linked firmware.elf. String literals have no symbol and only
+show in the totals. What is left is shared by the heap and the stack,
+see /sram on the board for how much of it they really use.
+
+    tools/sram_report.py [.pio/build/uno]
+
+Also runs after every link when listed in platformio.ini:
+
+    extra_scripts = post:tools/sram_report.py
+"""
+
+import os
+import subprocess
+import sys
+
+# ATmega328P
+SRAM_SIZE = 2048
+
+# nm symbol types that live in SRAM
+SRAM_TYPES = set("BbDdRrVC")
+
+
+def nm_sizes(nm, path, environ=None):
+    """Yields (symbol, size) for the SRAM symbols of an object file."""
+    output = subprocess.run([nm, "-S", path], env=environ,
+                            stdout=subprocess.PIPE, stderr=subprocess.DEVNULL,
+                            universal_newlines=True, check=False).stdout
+    for line in output.splitlines():
+        # address size type name
+        fields = line.split()
+        if len(fields) != 4 or fields[2] not in SRAM_TYPES:
+            continue
+        yield fields[3], int(fields[1], 16)
+
+
+def section_totals(size_tool, elf, environ=None):
+    output = subprocess.run([size_tool, "-A", elf], env=environ,
+                            stdout=subprocess.PIPE, stderr=subprocess.DEVNULL,
+                            universal_newlines=True, check=False).stdout
+    totals = {}
+    for line in output.splitlines():
+        fields = line.split()
+        if len(fields) >= 2 and fields[0] in (".data", ".bss", ".noinit"):
+            totals[fields[0]] = int(fields[1])
+    return totals
+
+
+def report(build_dir, nm="avr-nm", size_tool="avr-size", environ=None, top=5):
+    modules = {}
+    for root, _, files in os.walk(build_dir):
+        for name in sorted(files):
+            # Library archives are built from these same objects
+            if not name.endswith(".o"):
+                continue
+            path = os.path.join(root, name)
+            key = os.path.relpath(path, build_dir)
+            for symbol, size in nm_sizes(nm, path, environ):
+                modules.setdefault(key, []).append((size, symbol))
+
+    rows = sorted(modules.items(), key=lambda m: -sum(s for s, _ in m[1]))
+    print("%6s  %s" % ("bytes", "module (largest symbols)"))
+    for name, symbols in rows:
+        symbols.sort(reverse=True)
+        print("%6d  %s" % (sum(s for s, _ in symbols), name))
+        print("        " + ", ".join("%s %d" % (sym, size)
+                                      for size, sym in symbols[:top]))
+
+    elf = os.path.join(build_dir, "firmware.elf")
+    if os.path.exists(elf):
+        totals = section_totals(size_tool, elf, environ)
+        used = sum(totals.values())
+        print("linked: %s, %d of %d bytes, %d left for heap and stack" % (
+            ", ".join("%s %d" % t for t in sorted(totals.items())),
+            used, SRAM_SIZE, SRAM_SIZE - used))
+
+
+def main():
+    build_dir = sys.argv[1] if len(sys.argv) > 1 else ".pio/build/uno"
+    report(build_dir)
+
+
+try:
+    # PlatformIO extra script
+    Import("env")  # noqa: F821
+
+    def after_link(source, target, env):
+        report(env.subst("$BUILD_DIR"), environ=env["ENV"])
+
+    env.AddPostAction("$BUILD_DIR/${PROGNAME}.elf", after_link)  # noqa: F821
+except NameError:
+    if __name__ == "__main__":
+        main()
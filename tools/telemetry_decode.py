@@ -0,0 +1,111 @@
+#!/usr/bin/env python3
+"""Decode the binary telemetry stream written by src/Telemetry.cpp.
+
+Frames are COBS encoded and delimited by 0x00. Reads from a serial port
+(needs pyserial) or from a capture file, and prints one CSV line per
+record. Sequence gaps (records dropped on the board) are reported on
+stderr.
+
+    tools/telemetry_decode.py /dev/ttyACM0
+    tools/telemetry_decode.py capture.bin --file
+"""
+
+import argparse
+import struct
+import sys
+
+TELEMETRY_SAMPLE = 1
+
+# Mirrors telemetry_sample_t in include/Telemetry.hpp
+SAMPLE = struct.Struct("<BBIhhBHHHHH")
+SAMPLE_FIELDS = ("seq", "timestamp", "code", "fs_mv", "volume", "filling",
+                 "transferring", "in_relay", "out_relay",
+                 "t_output_us", "t_coap_us", "t_run_us",
+                 "stack_peak", "sram_unused", "dhcp_failed")
+
+# ADS1115 full scale in mV for the PGA range in relays bits 4-6
+PGA_FULL_SCALE = (6144, 4096, 2048, 1024, 512, 256, 0, 0)
+
+
+def cobs_decode(frame):
+    out = bytearray()
+    i = 0
+    while i < len(frame):
+        code = frame[i]
+        if code == 0 or i + code > len(frame):
+            raise ValueError("bad COBS frame")
+        out += frame[i + 1:i + code]
+        i += code
+        if code < 0xFF and i < len(frame):
+            out.append(0)
+    return bytes(out)
+
+
+def decode_sample(record):
+    (_, seq, timestamp, code, volume, relays,
+     t_output, t_coap, t_run, stack_peak, sram_unused) = SAMPLE.unpack(record)
+    full_scale = PGA_FULL_SCALE[(relays >> 4) & 7]
+    return (seq, timestamp, code, full_scale, volume, relays & 1, (relays >> 1) & 1,
+            (relays >> 2) & 1, (relays >> 3) & 1, t_output, t_coap, t_run,
+            stack_peak, sram_unused, relays >> 7)
+
+
+def frames(stream):
+    pending = bytearray()
+    while True:
+        chunk = stream.read(256)
+        if not chunk:
+            return
+        pending += chunk
+        while True:
+            end = pending.find(b"\x00")
+            if end < 0:
+                break
+            frame = bytes(pending[:end])
+            del pending[:end + 1]
+            if frame:
+                yield frame
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("source", help="serial port, or capture file with --file")
+    parser.add_argument("--file", action="store_true", help="read a capture file")
+    parser.add_argument("--baud", type=int, default=250000)
+    args = parser.parse_args()
+
+    if args.file:
+        stream = open(args.source, "rb")
+    else:
+        import serial
+        stream = serial.Serial(args.source, args.baud, timeout=1)
+
+    print(",".join(SAMPLE_FIELDS))
+    last_seq = None
+    bad = 0
+    try:
+        for frame in frames(stream):
+            try:
+                record = cobs_decode(frame)
+            except ValueError:
+                bad += 1
+                continue
+            if len(record) != SAMPLE.size or record[0] != TELEMETRY_SAMPLE:
+                bad += 1
+                continue
+            row = decode_sample(record)
+            seq = row[0]
+            if last_seq is not None and seq != (last_seq + 1) & 0xFF:
+                print("gap: %d record(s) lost before seq %d"
+                      % ((seq - last_seq - 1) & 0xFF, seq), file=sys.stderr)
+            last_seq = seq
+            print(",".join(str(v) for v in row))
+            sys.stdout.flush()
+    except KeyboardInterrupt:
+        pass
+    if bad:
+        print("%d undecodable frame(s) skipped" % bad, file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()